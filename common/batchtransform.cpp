@@ -0,0 +1,96 @@
+/* batchtransform.cpp
+ Scalar and SSE versions of the batch transform kernel and the runtime dispatch between them
+ and the AVX2 version in batchtransform_avx2.cpp, using the detection in cpufeatures.cpp
+*/
+
+#include "batchtransform.h"
+#include "batchtransform_kernel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BATCHTRANSFORM_X86 1
+#include <emmintrin.h>
+#endif
+
+using namespace glm;
+
+/* Defined in batchtransform_avx2.cpp, which is compiled with AVX2 enabled */
+#ifdef BATCHTRANSFORM_X86
+void batchTransformAVX2(const BatchTransformArgs &args);
+#endif
+
+namespace
+{
+	struct ScalarOps
+	{
+		typedef float reg;
+		static const int width = 1;
+		static reg load(const float *p) { return *p; }
+		static void store(float *p, reg v) { *p = v; }
+		static reg set1(float f) { return f; }
+		static reg add(reg a, reg b) { return a + b; }
+		static reg sub(reg a, reg b) { return a - b; }
+		static reg mul(reg a, reg b) { return a * b; }
+		static reg div(reg a, reg b) { return a / b; }
+	};
+
+#ifdef BATCHTRANSFORM_X86
+	struct SSEOps
+	{
+		typedef __m128 reg;
+		static const int width = 4;
+		static reg load(const float *p) { return _mm_loadu_ps(p); }
+		static void store(float *p, reg v) { _mm_storeu_ps(p, v); }
+		static reg set1(float f) { return _mm_set1_ps(f); }
+		static reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+		static reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+		static reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+		static reg div(reg a, reg b) { return _mm_div_ps(a, b); }
+	};
+#endif
+}
+
+
+void batchTransform(const mat4 &view, const mat4 &projection, const Matrix4Batch &models,
+	Matrix4Batch *mv, Matrix4Batch *mvp, Matrix3Batch *normals)
+{
+	batchTransform(view, projection, models, mv, mvp, normals, getBestTransformISA());
+}
+
+
+void batchTransform(const mat4 &view, const mat4 &projection, const Matrix4Batch &models,
+	Matrix4Batch *mv, Matrix4Batch *mvp, Matrix3Batch *normals, TransformISA isa)
+{
+	if (models.size() == 0) return;
+	if (isa > getBestTransformISA()) isa = getBestTransformISA();
+
+	BatchTransformArgs args;
+	args.count = models.paddedSize();
+	for (int e = 0; e < 16; e++)
+	{
+		args.view[e] = view[e / 4][e % 4];
+		args.projection[e] = projection[e / 4][e % 4];
+		args.model[e] = models.elements(e);
+	}
+
+	if (mv) mv->resize(models.size());
+	if (mvp) mvp->resize(models.size());
+	if (normals) normals->resize(models.size());
+	for (int e = 0; e < 16; e++)
+	{
+		args.mv[e] = mv ? mv->elements(e) : NULL;
+		args.mvp[e] = mvp ? mvp->elements(e) : NULL;
+	}
+	for (int e = 0; e < 9; e++)
+	{
+		args.normal[e] = normals ? normals->elements(e) : NULL;
+	}
+
+	switch (isa)
+	{
+#ifdef BATCHTRANSFORM_X86
+		case TRANSFORM_AVX2: batchTransformAVX2(args); break;
+		case TRANSFORM_SSE: batchTransformKernel<SSEOps>(args); break;
+#endif
+		default: batchTransformKernel<ScalarOps>(args); break;
+	}
+}
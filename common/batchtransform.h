@@ -0,0 +1,73 @@
+/* batchtransform.h
+ Computes the model-view, model-view-projection and normal matrices for many objects at once.
+ The matrices are held in structure-of-arrays form (MatrixBatch), with each element of every
+ matrix stored contiguously, so that SSE and AVX2 can work on 4 or 8 objects per instruction.
+ The instruction set is chosen at runtime from what the CPU supports, with a scalar fallback.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+#include "cpufeatures.h"
+
+/* Matrices of size N x N stored element by element: all the [0][0] elements, then all the [0][1]
+   elements and so on (column major, like glm). The arrays are padded to a multiple of 8 matrices
+   so the kernels never need a partial block */
+template <int N>
+class MatrixBatch
+{
+public:
+	typedef glm::mat<N, N, float, glm::defaultp> matrix_type;
+
+	MatrixBatch(size_t count = 0) : count(0), stride(0) { resize(count); }
+
+	void resize(size_t count)
+	{
+		if (count == this->count && !data.empty()) return;
+		this->count = count;
+		stride = (count + 7) & ~(size_t)7;
+		data.assign(N * N * stride, 0.f);
+	}
+
+	size_t size() const { return count; }
+
+	void set(size_t i, const matrix_type &m)
+	{
+		for (int c = 0; c < N; c++)
+			for (int r = 0; r < N; r++)
+				data[(c * N + r) * stride + i] = m[c][r];
+	}
+
+	matrix_type get(size_t i) const
+	{
+		matrix_type m;
+		for (int c = 0; c < N; c++)
+			for (int r = 0; r < N; r++)
+				m[c][r] = data[(c * N + r) * stride + i];
+		return m;
+	}
+
+	/* The contiguous array holding element (column * N + row) of every matrix */
+	float *elements(int element) { return &data[element * stride]; }
+	const float *elements(int element) const { return &data[element * stride]; }
+
+	size_t paddedSize() const { return stride; }
+
+private:
+	size_t count, stride;
+	std::vector<float> data;
+};
+
+typedef MatrixBatch<4> Matrix4Batch;
+typedef MatrixBatch<3> Matrix3Batch;
+
+/* For each model matrix compute mv = view * model, mvp = projection * mv and the normal matrix
+   transpose(inverse(mat3(mv))). Any of the outputs can be NULL if it isn't needed, the others are
+   resized to match models. The second version forces an instruction set, which is lowered to the
+   best supported one if the CPU doesn't have it */
+void batchTransform(const glm::mat4 &view, const glm::mat4 &projection, const Matrix4Batch &models,
+	Matrix4Batch *mv, Matrix4Batch *mvp, Matrix3Batch *normals);
+void batchTransform(const glm::mat4 &view, const glm::mat4 &projection, const Matrix4Batch &models,
+	Matrix4Batch *mv, Matrix4Batch *mvp, Matrix3Batch *normals, TransformISA isa);
@@ -0,0 +1,38 @@
+/* batchtransform_avx2.cpp
+ AVX2 version of the batch transform kernel. This file is compiled with AVX2 code generation
+ enabled, so it must only be called after getBestTransformISA() has confirmed the CPU supports it.
+ Nothing else may be put in this file for the same reason.
+*/
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+
+#if defined(__GNUC__) && !defined(__AVX2__)
+#pragma GCC target("avx2")
+#endif
+
+#include <immintrin.h>
+#include "batchtransform_kernel.h"
+
+namespace
+{
+	struct AVX2Ops
+	{
+		typedef __m256 reg;
+		static const int width = 8;
+		static reg load(const float *p) { return _mm256_loadu_ps(p); }
+		static void store(float *p, reg v) { _mm256_storeu_ps(p, v); }
+		static reg set1(float f) { return _mm256_set1_ps(f); }
+		static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+		static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+		static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+		static reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+	};
+}
+
+void batchTransformAVX2(const BatchTransformArgs &args)
+{
+	batchTransformKernel<AVX2Ops>(args);
+	_mm256_zeroupper();
+}
+
+#endif
@@ -0,0 +1,111 @@
+/* batchtransform_kernel.h
+ The batch transform kernel, written once against a small set of vector operations (V) and
+ instantiated for scalar, SSE and AVX2 in batchtransform.cpp and batchtransform_avx2.cpp.
+ Only include this from those files. The kernel is in an anonymous namespace so that each file gets its
+ own copy compiled for its own instruction set.
+*/
+
+#pragma once
+
+#include <cstddef>
+
+/* Array pointers for one call of the kernel. The element arrays are indexed as in MatrixBatch */
+struct BatchTransformArgs
+{
+	float view[16], projection[16];
+	const float *model[16];
+	float *mv[16];		// NULL pointers mean the output isn't wanted
+	float *mvp[16];
+	float *normal[9];
+	size_t count;		// Multiple of 8
+};
+
+namespace
+{
+	/* One column of r = a * b, where a is the same for every object and b0-b3 are a column of b for a block
+	   of objects. Written out in full so that it stays in registers whether or not the compiler unrolls loops */
+	template <class V>
+	inline void multiplyColumn(const typename V::reg a[16], typename V::reg b0, typename V::reg b1,
+		typename V::reg b2, typename V::reg b3, typename V::reg r[4])
+	{
+		r[0] = V::add(V::add(V::mul(a[0], b0), V::mul(a[4], b1)), V::add(V::mul(a[8], b2), V::mul(a[12], b3)));
+		r[1] = V::add(V::add(V::mul(a[1], b0), V::mul(a[5], b1)), V::add(V::mul(a[9], b2), V::mul(a[13], b3)));
+		r[2] = V::add(V::add(V::mul(a[2], b0), V::mul(a[6], b1)), V::add(V::mul(a[10], b2), V::mul(a[14], b3)));
+		r[3] = V::add(V::add(V::mul(a[3], b0), V::mul(a[7], b1)), V::add(V::mul(a[11], b2), V::mul(a[15], b3)));
+	}
+
+	template <class V>
+	void batchTransformKernel(const BatchTransformArgs &args)
+	{
+		typedef typename V::reg reg;
+
+		reg view[16], projection[16];
+		for (int e = 0; e < 16; e++)
+		{
+			view[e] = V::set1(args.view[e]);
+			projection[e] = V::set1(args.projection[e]);
+		}
+
+		bool wantMV = args.mv[0] != NULL;
+		bool wantMVP = args.mvp[0] != NULL;
+		bool wantNormal = args.normal[0] != NULL;
+
+		for (size_t i = 0; i < args.count; i += V::width)
+		{
+			reg mv[16];
+			for (int c = 0; c < 4; c++)
+			{
+				const int e = c * 4;
+				multiplyColumn<V>(view, V::load(args.model[e] + i), V::load(args.model[e + 1] + i),
+					V::load(args.model[e + 2] + i), V::load(args.model[e + 3] + i), &mv[e]);
+
+				if (wantMV)
+				{
+					V::store(args.mv[e] + i, mv[e]);
+					V::store(args.mv[e + 1] + i, mv[e + 1]);
+					V::store(args.mv[e + 2] + i, mv[e + 2]);
+					V::store(args.mv[e + 3] + i, mv[e + 3]);
+				}
+
+				if (wantMVP)
+				{
+					reg mvp[4];
+					multiplyColumn<V>(projection, mv[e], mv[e + 1], mv[e + 2], mv[e + 3], mvp);
+					V::store(args.mvp[e] + i, mvp[0]);
+					V::store(args.mvp[e + 1] + i, mvp[1]);
+					V::store(args.mvp[e + 2] + i, mvp[2]);
+					V::store(args.mvp[e + 3] + i, mvp[3]);
+				}
+			}
+
+			/* transpose(inverse(A)) is the cofactor matrix of A divided by its determinant. Its columns are
+			   the cross products of pairs of columns of A, so no general inverse is needed */
+			if (wantNormal)
+			{
+				const reg *c0 = &mv[0], *c1 = &mv[4], *c2 = &mv[8];
+				reg n[9];
+				n[0] = V::sub(V::mul(c1[1], c2[2]), V::mul(c1[2], c2[1]));
+				n[1] = V::sub(V::mul(c1[2], c2[0]), V::mul(c1[0], c2[2]));
+				n[2] = V::sub(V::mul(c1[0], c2[1]), V::mul(c1[1], c2[0]));
+				n[3] = V::sub(V::mul(c2[1], c0[2]), V::mul(c2[2], c0[1]));
+				n[4] = V::sub(V::mul(c2[2], c0[0]), V::mul(c2[0], c0[2]));
+				n[5] = V::sub(V::mul(c2[0], c0[1]), V::mul(c2[1], c0[0]));
+				n[6] = V::sub(V::mul(c0[1], c1[2]), V::mul(c0[2], c1[1]));
+				n[7] = V::sub(V::mul(c0[2], c1[0]), V::mul(c0[0], c1[2]));
+				n[8] = V::sub(V::mul(c0[0], c1[1]), V::mul(c0[1], c1[0]));
+
+				reg det = V::add(V::add(V::mul(c0[0], n[0]), V::mul(c0[1], n[1])), V::mul(c0[2], n[2]));
+				reg invdet = V::div(V::set1(1.f), det);
+				V::store(args.normal[0] + i, V::mul(n[0], invdet));
+				V::store(args.normal[1] + i, V::mul(n[1], invdet));
+				V::store(args.normal[2] + i, V::mul(n[2], invdet));
+				V::store(args.normal[3] + i, V::mul(n[3], invdet));
+				V::store(args.normal[4] + i, V::mul(n[4], invdet));
+				V::store(args.normal[5] + i, V::mul(n[5], invdet));
+				V::store(args.normal[6] + i, V::mul(n[6], invdet));
+				V::store(args.normal[7] + i, V::mul(n[7], invdet));
+				V::store(args.normal[8] + i, V::mul(n[8], invdet));
+			}
+		}
+	}
+}
@@ -0,0 +1,424 @@
+/* bufferarena.cpp
+ Segregated fit sub-allocator for OpenGL buffers, see bufferarena.h
+*/
+
+#include "bufferarena.h"
+#include "wrapper_glfw.h"
+#include <algorithm>
+
+using namespace std;
+
+const GLuint NO_NODE = 0xffffffff;
+
+static int highestBit(GLuint value)
+{
+	int bit = 0;
+	while (value >>= 1) bit++;
+	return bit;
+}
+
+static int lowestBit(GLuint value)
+{
+	int bit = 0;
+	while (!(value & 1))
+	{
+		value >>= 1;
+		bit++;
+	}
+	return bit;
+}
+
+
+OffsetAllocator::OffsetAllocator(GLuint size)
+{
+	for (int i = 0; i < NUM_BINS; i++) binHeads[i] = NO_NODE;
+	for (int i = 0; i < NUM_BINS / 8; i++) binMasks[i] = 0;
+	binGroups = 0;
+	lastPhysical = NO_NODE;
+	capacity = used = allocations = freeBlocks = 0;
+
+	if (size > 0) grow(size);
+}
+
+
+/* Sizes below 8 have a bin each. Above that the bin is the size's power of two and the three bits below its
+   top bit, like a float with a 3 bit mantissa, so each bin covers sizes within 12.5% of each other.
+   Free blocks are filed under the bin their size rounds down to. A request is looked for from the bin its size
+   rounds up to, where every block is big enough */
+GLuint OffsetAllocator::binRoundDown(GLuint size)
+{
+	if (size < 8) return size;
+	int top = highestBit(size);
+	return ((top - 2) << 3) | ((size >> (top - 3)) & 7);
+}
+
+
+GLuint OffsetAllocator::binRoundUp(GLuint size)
+{
+	GLuint bin = binRoundDown(size);
+	if (size >= 8 && (size & ((1u << (highestBit(size) - 3)) - 1)) != 0) bin++;
+	return bin;
+}
+
+
+/* First non-empty bin at or above minBin, or NO_NODE */
+GLuint OffsetAllocator::findBin(GLuint minBin) const
+{
+	if (minBin >= (GLuint)NUM_BINS) return NO_NODE;
+
+	GLuint group = minBin >> 3;
+	GLuint bins = binMasks[group] & (0xff << (minBin & 7));
+	if (bins) return (group << 3) + lowestBit(bins);
+
+	// Any later group with a non-empty bin. 2 << 31 is 0, which leaves no groups when group is the last one
+	GLuint groups = binGroups & ~((2u << group) - 1);
+	if (!groups) return NO_NODE;
+	group = lowestBit(groups);
+	return (group << 3) + lowestBit(binMasks[group]);
+}
+
+
+GLuint OffsetAllocator::newNode(GLuint offset, GLuint size)
+{
+	Node node;
+	node.offset = offset;
+	node.size = size;
+	node.prevPhysical = node.nextPhysical = NO_NODE;
+	node.prevFree = node.nextFree = NO_NODE;
+	node.used = false;
+
+	if (!unusedNodes.empty())
+	{
+		GLuint index = unusedNodes.back();
+		unusedNodes.pop_back();
+		nodes[index] = node;
+		return index;
+	}
+	nodes.push_back(node);
+	return (GLuint)nodes.size() - 1;
+}
+
+
+void OffsetAllocator::insertFree(GLuint node)
+{
+	GLuint bin = binRoundDown(nodes[node].size);
+	nodes[node].prevFree = NO_NODE;
+	nodes[node].nextFree = binHeads[bin];
+	if (binHeads[bin] != NO_NODE) nodes[binHeads[bin]].prevFree = node;
+	binHeads[bin] = node;
+
+	binMasks[bin >> 3] |= 1 << (bin & 7);
+	binGroups |= 1u << (bin >> 3);
+	freeBlocks++;
+}
+
+
+void OffsetAllocator::removeFree(GLuint node)
+{
+	Node &n = nodes[node];
+	if (n.prevFree != NO_NODE) nodes[n.prevFree].nextFree = n.nextFree;
+	if (n.nextFree != NO_NODE) nodes[n.nextFree].prevFree = n.prevFree;
+
+	GLuint bin = binRoundDown(n.size);
+	if (binHeads[bin] == node)
+	{
+		binHeads[bin] = n.nextFree;
+		if (binHeads[bin] == NO_NODE)
+		{
+			binMasks[bin >> 3] &= ~(1 << (bin & 7));
+			if (!binMasks[bin >> 3]) binGroups &= ~(1u << (bin >> 3));
+		}
+	}
+	freeBlocks--;
+}
+
+
+ArenaHandle OffsetAllocator::allocate(GLuint size)
+{
+	if (size == 0) size = 1;
+
+	GLuint bin = findBin(binRoundUp(size));
+	GLuint node = bin != NO_NODE ? binHeads[bin] : NO_NODE;
+	if (node == NO_NODE)
+	{
+		/* The bin the size rounds down to can still hold a block that is big enough, which matters when the
+		   space is nearly full */
+		for (GLuint n = binHeads[binRoundDown(size)]; n != NO_NODE; n = nodes[n].nextFree)
+		{
+			if (nodes[n].size >= size)
+			{
+				node = n;
+				break;
+			}
+		}
+		if (node == NO_NODE) return ARENA_NO_HANDLE;
+	}
+	removeFree(node);
+
+	/* Split off the rest of the block as a new free block after this one */
+	GLuint remainder = nodes[node].size - size;
+	if (remainder > 0)
+	{
+		GLuint rest = newNode(nodes[node].offset + size, remainder);
+		nodes[rest].prevPhysical = node;
+		nodes[rest].nextPhysical = nodes[node].nextPhysical;
+		if (nodes[node].nextPhysical != NO_NODE) nodes[nodes[node].nextPhysical].prevPhysical = rest;
+		else lastPhysical = rest;
+		nodes[node].nextPhysical = rest;
+		nodes[node].size = size;
+		insertFree(rest);
+	}
+
+	nodes[node].used = true;
+	used += size;
+	allocations++;
+	return node;
+}
+
+
+void OffsetAllocator::free(ArenaHandle handle)
+{
+	GLuint node = handle;
+	used -= nodes[node].size;
+	allocations--;
+	nodes[node].used = false;
+
+	/* Merge with the free blocks either side, so free space is never split between neighbouring blocks */
+	GLuint prev = nodes[node].prevPhysical;
+	if (prev != NO_NODE && !nodes[prev].used)
+	{
+		removeFree(prev);
+		nodes[prev].size += nodes[node].size;
+		nodes[prev].nextPhysical = nodes[node].nextPhysical;
+		if (nodes[node].nextPhysical != NO_NODE) nodes[nodes[node].nextPhysical].prevPhysical = prev;
+		if (lastPhysical == node) lastPhysical = prev;
+		unusedNodes.push_back(node);
+		node = prev;
+	}
+
+	GLuint next = nodes[node].nextPhysical;
+	if (next != NO_NODE && !nodes[next].used)
+	{
+		removeFree(next);
+		nodes[node].size += nodes[next].size;
+		nodes[node].nextPhysical = nodes[next].nextPhysical;
+		if (nodes[next].nextPhysical != NO_NODE) nodes[nodes[next].nextPhysical].prevPhysical = node;
+		if (lastPhysical == next) lastPhysical = node;
+		unusedNodes.push_back(next);
+	}
+
+	insertFree(node);
+}
+
+
+void OffsetAllocator::grow(GLuint newSize)
+{
+	if (newSize <= capacity) return;
+	GLuint extra = newSize - capacity;
+
+	if (lastPhysical != NO_NODE && !nodes[lastPhysical].used)
+	{
+		removeFree(lastPhysical);
+		nodes[lastPhysical].size += extra;
+		insertFree(lastPhysical);
+	}
+	else
+	{
+		GLuint node = newNode(capacity, extra);
+		nodes[node].prevPhysical = lastPhysical;
+		if (lastPhysical != NO_NODE) nodes[lastPhysical].nextPhysical = node;
+		lastPhysical = node;
+		insertFree(node);
+	}
+	capacity = newSize;
+}
+
+
+vector<GLuint> OffsetAllocator::compact()
+{
+	vector<GLuint> oldOffsets(nodes.size(), NO_NODE);
+
+	// Walk back from the end to list the allocations in order
+	vector<GLuint> live;
+	for (GLuint node = lastPhysical; node != NO_NODE; node = nodes[node].prevPhysical)
+	{
+		if (nodes[node].used) live.push_back(node);
+	}
+	reverse(live.begin(), live.end());
+
+	/* Every free block is dropped and the allocations are relinked end to end */
+	for (int i = 0; i < NUM_BINS; i++) binHeads[i] = NO_NODE;
+	for (int i = 0; i < NUM_BINS / 8; i++) binMasks[i] = 0;
+	binGroups = 0;
+	freeBlocks = 0;
+	unusedNodes.clear();
+	for (GLuint i = 0; i < nodes.size(); i++)
+	{
+		if (!nodes[i].used) unusedNodes.push_back(i);
+	}
+
+	GLuint offset = 0;
+	lastPhysical = NO_NODE;
+	for (size_t i = 0; i < live.size(); i++)
+	{
+		Node &n = nodes[live[i]];
+		oldOffsets[live[i]] = n.offset;
+		n.offset = offset;
+		n.prevPhysical = lastPhysical;
+		n.nextPhysical = NO_NODE;
+		if (lastPhysical != NO_NODE) nodes[lastPhysical].nextPhysical = live[i];
+		lastPhysical = live[i];
+		offset += n.size;
+	}
+
+	if (offset < capacity)
+	{
+		GLuint node = newNode(offset, capacity - offset);
+		nodes[node].prevPhysical = lastPhysical;
+		if (lastPhysical != NO_NODE) nodes[lastPhysical].nextPhysical = node;
+		lastPhysical = node;
+		insertFree(node);
+	}
+	return oldOffsets;
+}
+
+
+GLuint OffsetAllocator::getLargestFree() const
+{
+	if (!binGroups) return 0;
+
+	/* The largest block is in the highest non-empty bin, which holds a range of sizes */
+	GLuint group = highestBit(binGroups);
+	GLuint bin = (group << 3) + highestBit(binMasks[group]);
+	GLuint largest = 0;
+	for (GLuint node = binHeads[bin]; node != NO_NODE; node = nodes[node].nextFree)
+	{
+		largest = max(largest, nodes[node].size);
+	}
+	return largest;
+}
+
+
+BufferArena::BufferArena(GLsizeiptr elementSize, GLuint initialElements, GLuint alignment)
+{
+	this->elementSize = elementSize;
+	this->alignment = alignment > 0 ? alignment : 1;
+	this->initialElements = roundUp(initialElements > 0 ? initialElements : 1);
+	buffer = 0;
+	peak = 0;
+}
+
+
+/* Create the buffer the first time something is allocated, when there is a current context */
+void BufferArena::create()
+{
+	glGenBuffers(1, &buffer);
+	GLWrapper::state().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, elementSize * initialElements, NULL, GL_STATIC_DRAW);
+	allocator.grow(initialElements);
+}
+
+
+/* Copy count elements from each range of an old buffer to a new one. The old buffer is deleted */
+static void moveRanges(GLuint from, GLuint to, GLsizeiptr elementSize, const vector<GLuint> &oldOffsets,
+	const vector<GLuint> &newOffsets, const vector<GLuint> &counts)
+{
+	GLStateCache &gl = GLWrapper::state();
+	gl.bindBuffer(GL_COPY_READ_BUFFER, from);
+	gl.bindBuffer(GL_COPY_WRITE_BUFFER, to);
+	for (size_t i = 0; i < counts.size(); i++)
+	{
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, elementSize * oldOffsets[i],
+			elementSize * newOffsets[i], elementSize * counts[i]);
+	}
+
+	// Unbind the old name before deleting it so the state cache can't be left holding it
+	gl.bindBuffer(GL_COPY_READ_BUFFER, 0);
+	glDeleteBuffers(1, &from);
+}
+
+
+ArenaHandle BufferArena::allocate(GLuint count)
+{
+	if (buffer == 0) create();
+
+	GLuint size = roundUp(count > 0 ? count : 1);
+	ArenaHandle handle = allocator.allocate(size);
+	while (handle == ARENA_NO_HANDLE)
+	{
+		/* Double the buffer, copying the old contents to the same offsets in the new one */
+		GLuint oldCapacity = allocator.getCapacity();
+		GLuint newCapacity = max(oldCapacity * 2, roundUp(oldCapacity + size));
+
+		GLuint grown;
+		glGenBuffers(1, &grown);
+		GLWrapper::state().bindBuffer(GL_COPY_WRITE_BUFFER, grown);
+		glBufferData(GL_COPY_WRITE_BUFFER, elementSize * newCapacity, NULL, GL_STATIC_DRAW);
+		moveRanges(buffer, grown, elementSize, vector<GLuint>(1, 0), vector<GLuint>(1, 0), vector<GLuint>(1, oldCapacity));
+		buffer = grown;
+
+		allocator.grow(newCapacity);
+		handle = allocator.allocate(size);
+	}
+
+	peak = max(peak, allocator.getUsed());
+	return handle;
+}
+
+
+void BufferArena::free(ArenaHandle handle)
+{
+	allocator.free(handle);
+}
+
+
+void BufferArena::upload(ArenaHandle handle, const void *data, GLuint count)
+{
+	GLWrapper::state().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, elementSize * allocator.getOffset(handle), elementSize * count, data);
+}
+
+
+bool BufferArena::defragment()
+{
+	if (buffer == 0) return false;
+
+	vector<GLuint> oldOffsets = allocator.compact();
+	vector<GLuint> from, to, counts;
+	bool moved = false;
+	for (GLuint handle = 0; handle < oldOffsets.size(); handle++)
+	{
+		if (oldOffsets[handle] == NO_NODE) continue;
+		from.push_back(oldOffsets[handle]);
+		to.push_back(allocator.getOffset(handle));
+		counts.push_back(allocator.getSize(handle));
+		moved = moved || from.back() != to.back();
+	}
+	if (!moved) return false;
+
+	/* glCopyBufferSubData can't copy between overlapping ranges of one buffer, so every allocation is copied
+	   to a new buffer */
+	GLuint packed;
+	glGenBuffers(1, &packed);
+	GLWrapper::state().bindBuffer(GL_COPY_WRITE_BUFFER, packed);
+	glBufferData(GL_COPY_WRITE_BUFFER, elementSize * allocator.getCapacity(), NULL, GL_STATIC_DRAW);
+	moveRanges(buffer, packed, elementSize, from, to, counts);
+	buffer = packed;
+	return true;
+}
+
+
+BufferArenaStats BufferArena::getStats() const
+{
+	BufferArenaStats stats;
+	stats.capacity = elementSize * allocator.getCapacity();
+	stats.used = elementSize * allocator.getUsed();
+	stats.peak = elementSize * peak;
+	stats.largestFree = elementSize * allocator.getLargestFree();
+	stats.allocations = allocator.getAllocations();
+	stats.freeBlocks = allocator.getFreeBlocks();
+
+	GLsizeiptr freeBytes = stats.capacity - stats.used;
+	stats.fragmentation = freeBytes > 0 ? 1.f - (float)stats.largestFree / freeBytes : 0.f;
+	return stats;
+}
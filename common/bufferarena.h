@@ -0,0 +1,118 @@
+/* bufferarena.h
+ Sub-allocation of large OpenGL buffers, so that making and deleting many small meshes doesn't
+ create and delete a driver buffer for each one.
+
+ OffsetAllocator does the bookkeeping. It hands out ranges of a fixed size space with a two-level
+ segregated fit scheme (as in TLSF): free blocks are kept in bins by size, 8 bins for each power
+ of two, with a bitmask of the non-empty bins so that finding a block that fits, splitting it and
+ merging a freed block with its free neighbours are all constant time.
+
+ BufferArena puts an OffsetAllocator over a GL buffer. Sizes and offsets are in elements (vertices
+ or indices) rather than bytes, and every offset is a multiple of the arena's alignment. When the
+ buffer is full it is replaced with one twice the size and the contents copied on the GPU, and
+ defragment() packs every allocation to the start of a new buffer. Both keep the handles valid
+ but change the offsets and the buffer name, so users must read them again afterwards.
+*/
+
+#pragma once
+
+#include <glload/gl_4_0.h>
+#include <vector>
+
+typedef GLuint ArenaHandle;
+const ArenaHandle ARENA_NO_HANDLE = 0xffffffff;
+
+/* Sizes are in bytes */
+struct BufferArenaStats
+{
+	GLsizeiptr capacity;
+	GLsizeiptr used;
+	GLsizeiptr peak;			// Highest used since the arena was created
+	GLsizeiptr largestFree;
+	GLuint allocations;
+	GLuint freeBlocks;
+	float fragmentation;		// 0 when all the free space is one block, approaching 1 as it is split up
+};
+
+class OffsetAllocator
+{
+public:
+	OffsetAllocator(GLuint size = 0);
+
+	/* Returns ARENA_NO_HANDLE if there is no free block big enough */
+	ArenaHandle allocate(GLuint size);
+	void free(ArenaHandle handle);
+
+	/* Add space to the end, merging it with the last block if that is free */
+	void grow(GLuint newSize);
+
+	/* Move every allocation down to the start in the same order, leaving one free block at the end. Returns
+	   each allocation's old offset, indexed by handle, so that the contents can be moved to match */
+	std::vector<GLuint> compact();
+
+	GLuint getOffset(ArenaHandle handle) const { return nodes[handle].offset; }
+	GLuint getSize(ArenaHandle handle) const { return nodes[handle].size; }
+	GLuint getCapacity() const { return capacity; }
+	GLuint getUsed() const { return used; }
+	GLuint getLargestFree() const;
+	GLuint getAllocations() const { return allocations; }
+	GLuint getFreeBlocks() const { return freeBlocks; }
+
+private:
+	struct Node
+	{
+		GLuint offset, size;
+		GLuint prevPhysical, nextPhysical;	// Neighbouring blocks in the space, free or used
+		GLuint prevFree, nextFree;			// Other free blocks in the same bin
+		bool used;
+	};
+
+	static const int NUM_BINS = 256;
+
+	static GLuint binRoundDown(GLuint size);
+	static GLuint binRoundUp(GLuint size);
+	GLuint findBin(GLuint minBin) const;
+
+	GLuint newNode(GLuint offset, GLuint size);
+	void insertFree(GLuint node);
+	void removeFree(GLuint node);
+
+	std::vector<Node> nodes;
+	std::vector<GLuint> unusedNodes;
+	GLuint binHeads[NUM_BINS];
+	GLuint binGroups;					// Bit g set when any of bins g*8 to g*8+7 is non-empty
+	unsigned char binMasks[NUM_BINS / 8];	// Bit b of group g set when bin g*8+b is non-empty
+	GLuint lastPhysical;
+	GLuint capacity, used, allocations, freeBlocks;
+};
+
+class BufferArena
+{
+public:
+	BufferArena(GLsizeiptr elementSize, GLuint initialElements, GLuint alignment = 1);
+
+	/* Reserve count elements, growing the buffer if needed */
+	ArenaHandle allocate(GLuint count);
+	void free(ArenaHandle handle);
+
+	/* Copy an allocation's contents in, count elements from the start of the allocation */
+	void upload(ArenaHandle handle, const void *data, GLuint count);
+
+	/* Pack the allocations together so the free space is one block. Returns false if there was nothing to move */
+	bool defragment();
+
+	GLuint getOffset(ArenaHandle handle) const { return allocator.getOffset(handle); }
+	GLuint getBuffer() const { return buffer; }
+	BufferArenaStats getStats() const;
+
+private:
+	void create();
+	GLuint roundUp(GLuint count) const { return (count + alignment - 1) / alignment * alignment; }
+
+	OffsetAllocator allocator;
+	GLuint buffer;
+	GLsizeiptr elementSize;
+	GLuint initialElements;
+	GLuint alignment;
+	GLuint peak;
+};
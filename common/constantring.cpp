@@ -0,0 +1,148 @@
+/* constantring.cpp
+ Fenced ring buffer for per-draw constants, see constantring.h
+*/
+
+#include "constantring.h"
+#include "wrapper_glfw.h"
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+ConstantRing::ConstantRing(GLsizeiptr frameSize)
+{
+	buffer = 0;
+	capacity = frameSize * CONSTANT_RING_FRAMES;
+	alignment = 256;
+	persistent = false;
+	mapped = NULL;
+	head = tail = frameStart = 0;
+	stalls = 0;
+	pushed = 0;
+}
+
+
+/* Create the buffer the first time it is needed, when there is a current context */
+void ConstantRing::create()
+{
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+	glGenBuffers(1, &buffer);
+	GLWrapper::state().bindBuffer(GL_UNIFORM_BUFFER, buffer);
+
+	if (glext_ARB_buffer_storage)
+	{
+		/* Coherent so that writes are visible to the GPU without an explicit flush */
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_UNIFORM_BUFFER, capacity, NULL, flags);
+		mapped = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, capacity, flags);
+		persistent = mapped != NULL;
+	}
+	else
+	{
+		glBufferData(GL_UNIFORM_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+	}
+}
+
+
+void ConstantRing::beginFrame()
+{
+	if (buffer == 0) create();
+
+	/* Limit the frames in flight, so a frame never starts until the GPU has finished with the space of the
+	   frame CONSTANT_RING_FRAMES ago */
+	while (frames.size() >= (size_t)CONSTANT_RING_FRAMES)
+	{
+		waitForOldestFrame();
+	}
+	frameStart = head;
+}
+
+
+void ConstantRing::endFrame()
+{
+	if (head == frameStart) return;	// Nothing written, so nothing for the GPU to finish with
+
+	FrameFence frame;
+	frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frame.start = frameStart;
+	frames.push_back(frame);
+	frameStart = head;
+}
+
+
+/* Wait until the GPU has passed the fence of the oldest frame in flight, then release its space */
+void ConstantRing::waitForOldestFrame()
+{
+	FrameFence &oldest = frames.front();
+
+	GLenum result = glClientWaitSync(oldest.fence, 0, 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+	{
+		stalls++;
+		while (result == GL_TIMEOUT_EXPIRED)
+		{
+			result = glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		}
+	}
+	glDeleteSync(oldest.fence);
+	frames.pop_front();
+
+	// The space now ends at the start of the next frame in flight, or the frame being written
+	tail = frames.empty() ? frameStart : frames.front().start;
+}
+
+
+GLintptr ConstantRing::push(const void *data, GLsizeiptr size)
+{
+	if (buffer == 0) create();
+
+	/* Align the start, and go back to the start of the buffer rather than split the block over the end */
+	unsigned long long position = (head + alignment - 1) / alignment * alignment;
+	if (position % capacity + size > (unsigned long long)capacity)
+	{
+		position += capacity - position % capacity;
+	}
+
+	/* If the ring is full wait for the GPU to finish with older frames. If it is full with just the current
+	   frame, close it off with a fence early so that its first part can be waited for too */
+	while (position + size - tail > (unsigned long long)capacity)
+	{
+		if (frames.empty())
+		{
+			if (frameStart == head)
+			{
+				cerr << "ConstantRing: a block of " << size << " bytes is bigger than the ring" << endl;
+				return 0;
+			}
+			endFrame();
+		}
+		waitForOldestFrame();
+	}
+
+	GLintptr offset = (GLintptr)(position % capacity);
+	if (persistent)
+	{
+		memcpy(mapped + offset, data, size);
+	}
+	else
+	{
+		/* The fences already guarantee the GPU isn't using this range, so tell the driver not to check */
+		GLWrapper::state().bindBuffer(GL_UNIFORM_BUFFER, buffer);
+		void *p = glMapBufferRange(GL_UNIFORM_BUFFER, offset, size,
+			GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+		memcpy(p, data, size);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+	}
+
+	head = position + size;
+	pushed += size;
+	return offset;
+}
+
+
+void ConstantRing::pushUniforms(GLuint binding, const void *data, GLsizeiptr size)
+{
+	GLintptr offset = push(data, size);
+	GLWrapper::state().bindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+}
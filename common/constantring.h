@@ -0,0 +1,68 @@
+/* constantring.h
+ A streaming ring buffer for per-draw shader constants. Each draw copies its constants into the
+ ring and binds that range to a uniform block binding point with glBindBufferRange, so setting
+ the constants for a draw costs a memcpy and one bind instead of a glUniform call per value.
+
+ Up to CONSTANT_RING_FRAMES frames can be in flight. The end of each frame is marked with a fence
+ and space is only reused once the fence of the frame that wrote it has been passed, so the
+ buffer never needs the driver to synchronise for us.
+ When GL_ARB_buffer_storage is available the buffer is mapped once, persistently. Otherwise each
+ block of constants is written through an unsynchronised glMapBufferRange of just its range.
+*/
+
+#pragma once
+
+#include <glload/gl_4_0.h>
+#include <deque>
+
+const int CONSTANT_RING_FRAMES = 3;
+
+class ConstantRing
+{
+public:
+	ConstantRing(GLsizeiptr frameSize = 64 * 1024);
+
+	void beginFrame();
+	void endFrame();
+
+	/* Copy size bytes into the ring and return their offset in the buffer, which is suitably aligned to bind
+	   as a uniform block */
+	GLintptr push(const void *data, GLsizeiptr size);
+
+	/* push() the data and bind it to a uniform block binding point */
+	void pushUniforms(GLuint binding, const void *data, GLsizeiptr size);
+
+	GLuint getBuffer() const { return buffer; }
+	bool isPersistent() const { return persistent; }
+
+	/* Number of times the CPU had to wait for the GPU to finish with a frame's space, since the start */
+	unsigned int getStalls() const { return stalls; }
+
+	/* Bytes of constants copied into the ring since the start */
+	unsigned long long getBytesPushed() const { return pushed; }
+
+private:
+	struct FrameFence
+	{
+		GLsync fence;
+		unsigned long long start;	// Ring position where the frame's constants start
+	};
+
+	void create();
+	void waitForOldestFrame();
+
+	GLuint buffer;
+	GLsizeiptr capacity;
+	GLint alignment;
+	bool persistent;
+	unsigned char *mapped;
+
+	// Positions count bytes written since the start and only increase, the offset in the buffer is position % capacity
+	unsigned long long head;
+	unsigned long long tail;			// Start of the oldest frame the GPU may still be reading
+	unsigned long long frameStart;
+	std::deque<FrameFence> frames;
+
+	unsigned int stalls;
+	unsigned long long pushed;
+};
@@ -0,0 +1,82 @@
+/* cpufeatures.cpp
+ Instruction set detection through CPUID, see cpufeatures.h
+*/
+
+#include "cpufeatures.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPUFEATURES_X86 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace
+{
+#ifdef CPUFEATURES_X86
+	void cpuid(int info[4], int leaf, int subleaf)
+	{
+#ifdef _MSC_VER
+		__cpuidex(info, leaf, subleaf);
+#else
+		unsigned int a, b, c, d;
+		__cpuid_count(leaf, subleaf, a, b, c, d);
+		info[0] = a; info[1] = b; info[2] = c; info[3] = d;
+#endif
+	}
+
+	unsigned long long xgetbv0()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		unsigned int lo, hi;
+		__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+		return ((unsigned long long)hi << 32) | lo;
+#endif
+	}
+#endif
+
+	/* SSE2 is part of x86-64 and of every x86 CPU that can run the examples. AVX2 also needs the
+	   operating system to save the YMM registers, which is checked through XGETBV */
+	TransformISA detectISA()
+	{
+#ifdef CPUFEATURES_X86
+		int info[4];
+		cpuid(info, 0, 0);
+		int maxleaf = info[0];
+
+		cpuid(info, 1, 0);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (maxleaf >= 7 && osxsave && avx && (xgetbv0() & 6) == 6)
+		{
+			cpuid(info, 7, 0);
+			if (info[1] & (1 << 5)) return TRANSFORM_AVX2;
+		}
+		return TRANSFORM_SSE;
+#else
+		return TRANSFORM_SCALAR;
+#endif
+	}
+}
+
+
+TransformISA getBestTransformISA()
+{
+	static TransformISA best = detectISA();
+	return best;
+}
+
+
+const char *getTransformISAName(TransformISA isa)
+{
+	switch (isa)
+	{
+		case TRANSFORM_AVX2: return "AVX2";
+		case TRANSFORM_SSE: return "SSE";
+		default: return "scalar";
+	}
+}
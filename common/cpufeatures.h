@@ -0,0 +1,18 @@
+/* cpufeatures.h
+ The SIMD instruction sets the CPU can run, detected once at runtime. The batch transform kernel
+ and the frustum and occlusion cullers use it to choose between their scalar, SSE and AVX2 code,
+ and it needs nothing else, so code using it doesn't depend on any of those.
+*/
+
+#pragma once
+
+enum TransformISA
+{
+	TRANSFORM_SCALAR,
+	TRANSFORM_SSE,
+	TRANSFORM_AVX2
+};
+
+/* The fastest instruction set supported by this CPU, detected once */
+TransformISA getBestTransformISA();
+const char *getTransformISAName(TransformISA isa);
@@ -8,6 +8,7 @@
 /* I don't like using namespaces in header files but have less issues with them in
 seperate cpp files */
 using namespace std;
+using namespace glm;
 
 /* Define the vertex attributes for vertex positions and normals.
 Make these match your application and vertex shader
@@ -232,67 +233,56 @@ void Cube::makeCube(int color)
 		0, 1.f, 0, 0, 1.f, 0, 0, 1.f, 0,
 	};
 
-	/* Create the vertex buffer for the cube */
-	glGenBuffers(1, &positionBufferObject);
-	glBindBuffer(GL_ARRAY_BUFFER, positionBufferObject);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertexPositions), vertexPositions, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	/* Create the colours buffer for the cube */
-	glGenBuffers(1, &colourObject);
-	glBindBuffer(GL_ARRAY_BUFFER, colourObject);
+	/* Choose the colour set for this cube */
+	GLfloat *colours = vertexColours;
 	if (color == 1) {
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertexColoursBrown), vertexColoursBrown, GL_STATIC_DRAW);
+		colours = vertexColoursBrown;
 	}
 	else if (color == 2) {
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertexColoursDarkBrown), vertexColoursDarkBrown, GL_STATIC_DRAW);
+		colours = vertexColoursDarkBrown;
 	}
-	else {
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertexColours), vertexColours, GL_STATIC_DRAW);
+
+	/* Interleave the positions, colours and normals into the packed vertex format */
+	PackedVertex vertices[36];
+	for (int i = 0; i < numvertices * 3; i++)
+	{
+		vec3 position(vertexPositions[i * 3], vertexPositions[i * 3 + 1], vertexPositions[i * 3 + 2]);
+		vec3 normal(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]);
+		vec4 colour(colours[i * 4], colours[i * 4 + 1], colours[i * 4 + 2], colours[i * 4 + 3]);
+		vertices[i] = packVertex(position, normal, colour);
 	}
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	/* Create the normals  buffer for the cube */
-	glGenBuffers(1, &normalsBufferObject);
-	glBindBuffer(GL_ARRAY_BUFFER, normalsBufferObject);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(normals), normals, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	/* Each face has its own normals so no vertices are shared and the indices just count up. They are
+	   only needed so that the cube can be drawn with the indexed meshes in one batch */
+	GLuint indices[36];
+	for (GLuint i = 0; i < 36; i++)
+	{
+		indices[i] = i;
+	}
+
+	/* Copy the cube into the shared mesh buffer */
+	mesh = GLWrapper::meshes().add(vertices, 36, indices, 36);
 }
 
 
-/* Draw the cube by bining the VBOs and drawing triangles */
+/* Draw the cube from its range of the shared mesh buffer */
 void Cube::drawCube(int drawmode)
 {
-	/* Bind cube vertices. Note that this is in attribute index attribute_v_coord */
-	glBindBuffer(GL_ARRAY_BUFFER, positionBufferObject);
-	glEnableVertexAttribArray(attribute_v_coord);
-	glVertexAttribPointer(attribute_v_coord, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-	/* Bind cube colours. Note that this is in attribute index attribute_v_colours */
-	glBindBuffer(GL_ARRAY_BUFFER, colourObject);
-	glEnableVertexAttribArray(attribute_v_colours);
-	glVertexAttribPointer(attribute_v_colours, 4, GL_FLOAT, GL_FALSE, 0, 0);
-
-	/* Bind cube normals. Note that this is in attribute index attribute_v_normal */
-	glEnableVertexAttribArray(attribute_v_normal);
-	glBindBuffer(GL_ARRAY_BUFFER, normalsBufferObject);
-	glVertexAttribPointer(attribute_v_normal, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-	glPointSize(3.f);
+	GLWrapper::state().pointSize(3.f);
 
 	// Switch between filled and wireframe modes
 	if (drawmode == 1)
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		GLWrapper::state().polygonMode(GL_LINE);
 	else
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		GLWrapper::state().polygonMode(GL_FILL);
 
-	// Draw points
-	if (drawmode == 2)
-	{
-		glDrawArrays(GL_POINTS, 0, numvertices * 3);
-	}
-	else // Draw the cube in triangles
-	{
-		glDrawArrays(GL_TRIANGLES, 0, numvertices * 3);
-	}
+	// Draw points or triangles
+	GLWrapper::meshes().draw(mesh, drawmode == 2 ? GL_POINTS : GL_TRIANGLES);
+}
+
+
+/* Add the cube to this frame's batch instead of drawing it now, see MeshBuffer::drawBatch */
+void Cube::batchCube(const mat4 &model, const mat3 &normal)
+{
+	GLWrapper::meshes().addToBatch(mesh, model, normal);
 }
\ No newline at end of file
@@ -6,6 +6,8 @@ Iain Martin November 2018
 #pragma once
 
 #include "wrapper_glfw.h"
+#include "vertexformat.h"
+#include "meshbuffer.h"
 #include <vector>
 #include <glm/glm.hpp>
 
@@ -17,11 +19,10 @@ public:
 
 	void makeCube(int color);
 	void drawCube(int drawmode);
+	void batchCube(const glm::mat4 &model, const glm::mat3 &normal);
 
-	// Define vertex buffer object names (e.g as globals)
-	GLuint positionBufferObject;
-	GLuint colourObject;
-	GLuint normalsBufferObject;
+	// The cube's vertices in the shared mesh buffer, set in makeCube
+	MeshHandle mesh;
 
 	GLuint attribute_v_coord;
 	GLuint attribute_v_normal;
@@ -5,20 +5,42 @@
 * Provided to the AC41001/AC51008 Graphics class to help debug their own cylinder objects or to
 * used in their assignment to provide another object to create models.
 *
-* The major limitation is that it is hard-coded to use 100 vertices in each rim. I would advise generalising
-* this in in functions defineVertices() and makeCylinder() so this will only work if it is defined with a 
-* definition of 100.
+* The number of vertices in each rim is set by the definition passed to the constructor (100 by default).
+* Lower levels of detail halve it each time, down to a minimum of 3.
+*
+* All three cylinders used in the cigar box (hinges, cigars and bands) have the same shape so they share
+* one set of buffers from the geometry cache below and only differ in the colour passed at draw time.
 */
 
 #include "cylinder.h"
 const float PI = 3.141592653589f;  /* pi */
 
 #include <iostream>
+#include <map>
+#include <vector>
+#include <tuple>
 
 using namespace glm;
 using namespace std;
 
 
+/* Geometry cache, keyed by (definition, radius, length). Entries live for the lifetime of the program */
+typedef tuple<GLuint, GLfloat, GLfloat> CylinderKey;
+static map<CylinderKey, CylinderGeometry> geometryCache;
+
+/* Gather the model matrices, normal matrices and colours of instanced draws in the mesh buffer's instance layout */
+static vector<MeshInstance> makeInstances(const mat4 *models, const mat3 *normals, const vec4 *colours, GLuint count)
+{
+	vector<MeshInstance> instances(count);
+	for (GLuint i = 0; i < count; i++)
+	{
+		instances[i].model = models[i];
+		instances[i].tint = colours[i];
+		instances[i].normal = normals[i];
+	}
+	return instances;
+}
+
 /**
  * IM: Constructor with no parameters which creates a white cylinder
  */
@@ -28,178 +50,262 @@ Cylinder::Cylinder () : Cylinder(vec3(0.804f, 0.498, 0.196f))
 }
 
 
-Cylinder::Cylinder(vec3 c) : colour(c)
+Cylinder::Cylinder(vec3 c) : Cylinder(c, 1.0f, 1.0f)
 {
-	this->radius = 1.0f;
-	this->length = 1.0f;
+
+}
+
+
+Cylinder::Cylinder(vec3 c, GLfloat radius, GLfloat length, GLuint definition) : colour(c)
+{
+	this->radius = radius;
+	this->length = length;
 
 	attribute_v_coord = 0;
 	attribute_v_colours = 1;
 	attribute_v_normal = 2;
 
-	// hard-coded number of vertices around the circle
-	// To change this value you will need to generalise the vertex number and offsets in
-	// functions defineVertices() and makeCylinder(). It has already been done in drawCylinder().
-	this->definition = 100;		
-	numberOfvertices = definition*4+2; //number of verticies in the cylinder
+	// number of vertices around the circle at the highest level of detail
+	if (definition < CYLINDER_MIN_DEFINITION) definition = CYLINDER_MIN_DEFINITION;
+	this->definition = definition;
+
+	// Each level of detail halves the number of segments until the next one would drop below the minimum
+	numlods = 1;
+	while (numlods < CYLINDER_MAX_LODS && (definition >> numlods) >= CYLINDER_MIN_DEFINITION)
+	{
+		numlods++;
+	}
+	for (GLuint i = 0; i < CYLINDER_MAX_LODS; i++)
+	{
+		lods[i] = NULL;
+	}
+	resetLODStats();
 }
 
 Cylinder::~Cylinder()
 {
 }
 
+/* Look up the buffers for this cylinder's full detail shape, creating them the first time the shape is used.
+   The lower levels of detail are created when they are first drawn */
 void Cylinder::makeCylinder()
 {
-	defineVertices();
+	lods[0] = findGeometry(definition, radius, length);
+}
+
+
+/* Number of segments around the rim at the given level of detail */
+GLuint Cylinder::getLODDefinition(GLuint lod) const
+{
+	if (lod >= numlods) lod = numlods - 1;
+	return definition >> lod;
+}
+
 
-	GLuint pindices[406]; //204 //201
-	for (int i = 0; i < 101; i++)
+/* Choose the coarsest level of detail that still has at least the requested number of segments */
+GLuint Cylinder::selectLOD(GLuint segments) const
+{
+	GLuint lod = 0;
+	while (lod + 1 < numlods && getLODDefinition(lod + 1) >= segments)
 	{
-		pindices[i] = i;
+		lod++;
 	}
-	pindices[101] = 1;
-	for (int i = 102; i < 203; i++)
+	return lod;
+}
+
+
+const CylinderGeometry *Cylinder::findGeometry(GLuint definition, GLfloat radius, GLfloat length)
+{
+	CylinderKey key(definition, radius, length);
+	map<CylinderKey, CylinderGeometry>::iterator found = geometryCache.find(key);
+	if (found != geometryCache.end())
 	{
-		pindices[i] = i -1;
+		return &found->second;
 	}
-	pindices[203] = 102;
 
-	for (int i = 204; i < 404; i++)
+	/* Index the cylinder as a single triangle list so that the whole cylinder (top lid, bottom lid
+	   and sides) can be submitted in one draw call, which is what allows it to be instanced.
+	   The vertex layout is: top centre, top rim, bottom centre, bottom rim, then the side
+	   vertices in top/bottom pairs. */
+	GLuint top_centre = 0;
+	GLuint top_rim = 1;
+	GLuint bottom_centre = definition + 1;
+	GLuint bottom_rim = definition + 2;
+	GLuint side_start = definition * 2 + 2;
+
+	GLuint isize = definition * 12;	// 4 triangles per segment: one in each lid and two in the side
+	GLuint *pindices = new GLuint[isize];
+	GLuint index = 0;
+	for (GLuint i = 0; i < definition; i++)
 	{
-		pindices[i] = i - 2;
+		GLuint next = (i + 1) % definition;
+
+		// Top lid
+		pindices[index++] = top_centre;
+		pindices[index++] = top_rim + i;
+		pindices[index++] = top_rim + next;
+
+		// Bottom lid
+		pindices[index++] = bottom_centre;
+		pindices[index++] = bottom_rim + i;
+		pindices[index++] = bottom_rim + next;
+
+		// Side quad made from two triangles
+		pindices[index++] = side_start + i * 2;
+		pindices[index++] = side_start + i * 2 + 1;
+		pindices[index++] = side_start + next * 2;
+
+		pindices[index++] = side_start + next * 2;
+		pindices[index++] = side_start + i * 2 + 1;
+		pindices[index++] = side_start + next * 2 + 1;
 	}
-	pindices[404] = 202;
-	pindices[405] = 203;
-	this->isize = (sizeof(pindices) / sizeof(*pindices));
-	glGenBuffers(1, &this->cylinderElementbuffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->cylinderElementbuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, isize * sizeof(GLuint), pindices, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	CylinderGeometry geometry = defineVertices(definition, radius, length, pindices, isize);
+	delete[] pindices;
+
+	return &(geometryCache[key] = geometry);
 }
+
+
 	//based on
 	//https://www.opengl.org/discussion_boards/showthread.php/167115-Creating-cylinder
-	void Cylinder::defineVertices()
+	CylinderGeometry Cylinder::defineVertices(GLuint definition, GLfloat radius, GLfloat length, const GLuint *indices, GLuint numindices)
 	{
-		vec3 vertices[402];
-		vec3 normals[402];
-		vec3 colour[402];
+		CylinderGeometry geometry;
+		geometry.numberOfvertices = definition * 4 + 2; //number of verticies in the cylinder
+
+		vector<vec3> vertices(geometry.numberOfvertices);
+		vector<vec3> normals(geometry.numberOfvertices);
+		vector<PackedVertex> packed(geometry.numberOfvertices);
 
-		//number of pVertieces is total points * 3;
-		GLfloat halfLength = this->length / 2;
+		// Offsets of each part of the cylinder in the vertex arrays
+		GLuint top_centre = 0;
+		GLuint top_rim = 1;
+		GLuint bottom_centre = definition + 1;
+		GLuint bottom_rim = definition + 2;
+		GLuint side_start = definition * 2 + 2;
+
+		GLfloat halfLength = length / 2;
 
 		//define vertex at the center/top of the cylider
-		vertices[0] = vec3(0, halfLength, 0);
-		normals[0] = vec3(0.0, 1.0, 0.0);
-		colour[0] = this->colour;
+		vertices[top_centre] = vec3(0, halfLength, 0);
+		normals[top_centre] = vec3(0.0, 1.0, 0.0);
+
+		//define vertex at the center/bottom of the cylider
+		vertices[bottom_centre] = vec3(0, -halfLength, 0);
+		normals[bottom_centre] = vec3(0.0, -1.0, 0.0);
 
-		//for every point around the circle
-		for (int i = 1; i < this->definition +1; i++)
+		//for every point around the circle define the top rim, bottom rim and the pair of side vertices
+		for (GLuint i = 0; i < definition; i++)
 		{
-			GLfloat theta = (2 * PI) / this->definition * i;
+			GLfloat theta = (2 * PI) / definition * (i + 1);
 
 			GLfloat x = radius * cos(theta);
-			GLfloat y = halfLength;
-			GLfloat z = radius*sin(theta);
+			GLfloat z = radius * sin(theta);
 
-			vertices[i] = vec3(x, y, z);
-			normals[i] = vec3(0.0, 1.0, 0.0);
-			colour[i] = this->colour;
-		}
-		vertices[101] = vec3(0, -halfLength, 0);
-		normals[101] = vec3(0.0, -1.0, 0.0);
-		colour[101] = this->colour;
+			vertices[top_rim + i] = vec3(x, halfLength, z);
+			normals[top_rim + i] = vec3(0.0, 1.0, 0.0);
 
-		//for every point around the circle
-		for (int i = 102; i < (this->definition*2) + 2; i++)
-		{
-			GLfloat theta = (2 * PI) / this->definition * (i - 102);
-			
-			GLfloat x = radius * cos(theta);
-			GLfloat y = -halfLength;
-			GLfloat z = radius* sin(theta);
+			vertices[bottom_rim + i] = vec3(x, -halfLength, z);
+			normals[bottom_rim + i] = vec3(0.0, -1.0, 0.0);
 
-			vertices[i] = vec3(x, y, z);
-			normals[i] = vec3(0.0, -1.0, 0.0);
-			colour[i] = this->colour;
+			vertices[side_start + i * 2] = vertices[top_rim + i];
+			normals[side_start + i * 2] = vec3(x, 0.0, z);
+			vertices[side_start + i * 2 + 1] = vertices[bottom_rim + i];
+			normals[side_start + i * 2 + 1] = vec3(x, 0.0, z);
 		}
 
-		//sides				202								402
-		int top = 1;
-		int bottom = 102;
-		for (int i = ((this->definition * 2) + 2); i < numberOfvertices; i += 2)
+		/* Interleave the positions and normals into the packed vertex format. The colour is supplied when
+		   the cylinder is drawn so the stored colour is just white */
+		for (GLuint i = 0; i < geometry.numberOfvertices; i++)
 		{
-			vertices[i] = vertices[top];
-			normals[i] = vec3(vertices[top].x, 0.0, vertices[top].z);
-			colour[i] = this->colour;
-			vertices[i + 1] = vertices[bottom];
-			normals[i + 1] = vec3(vertices[bottom].x, 0.0, vertices[bottom].z);
-			colour[i + 1] = this->colour;
-			top++;
-			bottom++;
+			packed[i] = packVertex(vertices[i], normals[i], vec4(1.f));
 		}
 
-		/* Create the vertex buffer for the cylinder */
-		glGenBuffers(1, &this->cylinderBufferObject);
-		glBindBuffer(GL_ARRAY_BUFFER, this->cylinderBufferObject);
-		glBufferData(GL_ARRAY_BUFFER, (sizeof(vec3) * numberOfvertices), &vertices[0], GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		glGenBuffers(1, &this->cylinderNormals);
-		glBindBuffer(GL_ARRAY_BUFFER, cylinderNormals);
-		glBufferData(GL_ARRAY_BUFFER, (sizeof(vec3) * numberOfvertices), &normals[0], GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		/* Store the colours in a buffer object */
-		glGenBuffers(1, &this->cylinderColours);
-		glBindBuffer(GL_ARRAY_BUFFER, cylinderColours);
-		glBufferData(GL_ARRAY_BUFFER, (sizeof(vec3)* numberOfvertices), &colour[0], GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		/* Copy the cylinder into the shared mesh buffer */
+		geometry.isize = numindices;
+		geometry.mesh = GLWrapper::meshes().add(&packed[0], geometry.numberOfvertices, indices, numindices);
+
+		return geometry;
 	}
 
-	void Cylinder::drawCylinder(int drawmode)
+	/* Get the shared geometry for a level of detail, building it if this is the first
+	   time it has been drawn */
+	const CylinderGeometry *Cylinder::getGeometry(GLuint lod)
 	{
-		/* Bind the vertes positions */
-		glEnableVertexAttribArray(attribute_v_coord);
-		glBindBuffer(GL_ARRAY_BUFFER, cylinderBufferObject);
-		glVertexAttribPointer(attribute_v_coord, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+		if (lod >= numlods) lod = numlods - 1;
+		if (lods[lod] == NULL)
+		{
+			lods[lod] = findGeometry(getLODDefinition(lod), radius, length);
+		}
+		return lods[lod];
+	}
 
-		/* Bind the colours */
-		glEnableVertexAttribArray(attribute_v_colours);
-		glBindBuffer(GL_ARRAY_BUFFER, this->cylinderColours);
-		glVertexAttribPointer(attribute_v_colours, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	/* Get the geometry for a level of detail that is about to be drawn count times, counting it in the stats */
+	const CylinderGeometry *Cylinder::drawGeometry(GLuint lod, GLuint count)
+	{
+		if (lod >= numlods) lod = numlods - 1;
+		const CylinderGeometry *geometry = getGeometry(lod);
+		lodStats.add(lod, count, geometry->isize / 3);
+		return geometry;
+	}
 
-		/* Bind the normals */
-		glEnableVertexAttribArray(attribute_v_normal);
-		glBindBuffer(GL_ARRAY_BUFFER, cylinderNormals);
-		glVertexAttribPointer(attribute_v_normal, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	void Cylinder::drawCylinder(int drawmode, GLuint lod)
+	{
+		const CylinderGeometry *geometry = drawGeometry(lod, 1);
 
-		glPointSize(3.f);
+		GLWrapper::state().pointSize(3.f);
 
 		// Enable this line to show model in wireframe
 		if (drawmode == 1)
-			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+			GLWrapper::state().polygonMode(GL_LINE);
 		else
-			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+			GLWrapper::state().polygonMode(GL_FILL);
 
-		if (drawmode == 2)
-		{
-			glDrawArrays(GL_POINTS, 0, numberOfvertices);
-		}
+		/* The stored vertex colour is white, the cylinder's colour is applied as the tint for this draw */
+		GLWrapper::meshes().draw(geometry->mesh, drawmode == 2 ? GL_POINTS : GL_TRIANGLES, vec4(colour, 1.f));
+	}
+
+	/* Draw count copies of the cylinder in this cylinder's colour */
+	void Cylinder::drawCylinderInstanced(int drawmode, const mat4 *models, const mat3 *normals, GLuint count, GLuint lod)
+	{
+		vector<vec4> colours(count, vec4(colour, 1.f));
+		drawCylinderInstanced(drawmode, models, normals, count ? &colours[0] : NULL, count, lod);
+	}
+
+	/* Draw count copies of the cylinder in one call. The model matrices, eye space normal matrices and colours
+	   are streamed into the mesh buffer's instance buffer and read by the vertex shader from per-instance
+	   attributes instead of uniforms, so the shader must have its instanced flag set while this is called. Because every cylinder of
+	   the same shape shares its geometry, copies of differently coloured cylinders can be drawn together. */
+	void Cylinder::drawCylinderInstanced(int drawmode, const mat4 *models, const mat3 *normals, const vec4 *colours, GLuint count, GLuint lod)
+	{
+		if (count == 0) return;
+
+		const CylinderGeometry *geometry = drawGeometry(lod, count);
+		vector<MeshInstance> instances = makeInstances(models, normals, colours, count);
+
+		GLWrapper::state().pointSize(3.f);
+
+		// Enable this line to show model in wireframe
+		if (drawmode == 1)
+			GLWrapper::state().polygonMode(GL_LINE);
 		else
-		{
-			int numfanvertices = definition + 2;
-			int numsidevertices = numfanvertices * 2;
-			int side_offset = definition * 2 + 2;
-			// Draw the cylinder using filled triangles
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->cylinderElementbuffer);
+			GLWrapper::state().polygonMode(GL_FILL);
+
+		GLWrapper::meshes().drawInstanced(geometry->mesh, drawmode == 2 ? GL_POINTS : GL_TRIANGLES, &instances[0], count);
+	}
 
-			// Draw the top lid
-			glDrawElements(GL_TRIANGLE_FAN, numfanvertices, GL_UNSIGNED_INT, (GLvoid*)0);
+	void Cylinder::batchCylinder(const mat4 &model, const mat3 &normal, GLuint lod)
+	{
+		GLWrapper::meshes().addToBatch(drawGeometry(lod, 1)->mesh, model, normal, vec4(colour, 1.f));
+	}
 
-			// Draw the bottom lid
-			glDrawElements(GL_TRIANGLE_FAN, numfanvertices, GL_UNSIGNED_INT, (GLvoid*)(numfanvertices * sizeof(GLuint)));
+	/* Nothing to draw mustn't build the level of detail, which is only made when it is first drawn */
+	void Cylinder::batchCylinderInstanced(const mat4 *models, const mat3 *normals, const vec4 *colours, GLuint count, GLuint lod)
+	{
+		if (count == 0) return;
 
-			// Draw the sides
-			glDrawElements(GL_TRIANGLE_STRIP, side_offset, GL_UNSIGNED_INT, (GLvoid*)(numsidevertices * sizeof(GLuint)));
-		}
+		const CylinderGeometry *geometry = drawGeometry(lod, count);
+		vector<MeshInstance> instances = makeInstances(models, normals, colours, count);
+		GLWrapper::meshes().addToBatch(geometry->mesh, &instances[0], count);
 	}
\ No newline at end of file
@@ -3,38 +3,86 @@
  * Example of a cylinder. This was created by David Ogle in 2015 and updated and tidied up
  * by Iain Martin in November 2017.
  * Provided to the AC41001/AC51008 Graphics class to help debug their own cylinder objects or to
- * used in their assignment to provide another flexible 
+ * used in their assignment to provide another flexible
+ *
+ * The vertices and indices are held in a geometry cache shared by every cylinder with the
+ * same definition, radius and length, so differently coloured cylinders cost no extra GPU memory.
+ * The colour is applied per draw (or per instance) as the tint rather than stored in the vertices.
+ *
+ * Any definition (number of segments around the rim) from 3 upwards is supported. Each cylinder has a
+ * chain of levels of detail, each with half the segments of the one before, which are only built the
+ * first time they are drawn. The level is chosen per draw.
+ *
+ * Each tessellation is a range of the shared mesh buffer (see meshbuffer.h), so cylinders can be
+ * batched with the other meshes.
  */
 
 #ifndef CYLINDER_H
 #define CYLINDER_H
 
 #include "wrapper_glfw.h"
+#include "vertexformat.h"
+#include "meshbuffer.h"
+#include "lodselect.h"
 #include <glm/glm.hpp>
 
+const GLuint CYLINDER_MIN_DEFINITION = 3;
+const GLuint CYLINDER_MAX_LODS = LOD_MAX_LEVELS;
+
+/* One tessellation of a cylinder, owned by the geometry cache in cylinder.cpp */
+struct CylinderGeometry
+{
+	MeshHandle mesh;		// Interleaved PackedVertex data and triangle list indices in the shared mesh buffer
+	GLuint numberOfvertices;
+	GLuint isize;
+};
+
 class Cylinder
 {
 private:
 	glm::vec3 colour;
 	GLfloat radius, length;
 	GLuint definition;
-	GLuint cylinderBufferObject, cylinderNormals, cylinderColours, cylinderElementbuffer;
-	GLuint num_pvertices;
-	GLuint isize;
-	GLuint numberOfvertices;
+	GLuint numlods;
+	const CylinderGeometry *lods[CYLINDER_MAX_LODS];
+	LODStats lodStats;
 
 	GLuint attribute_v_coord;
 	GLuint attribute_v_normal;
 	GLuint attribute_v_colours;
 
-	void defineVertices();
+	const CylinderGeometry *findGeometry(GLuint definition, GLfloat radius, GLfloat length);
+	static CylinderGeometry defineVertices(GLuint definition, GLfloat radius, GLfloat length, const GLuint *indices, GLuint numindices);
+	const CylinderGeometry *getGeometry(GLuint lod);
+	const CylinderGeometry *drawGeometry(GLuint lod, GLuint count);
 
 public:
 	Cylinder();
 	Cylinder(glm::vec3 c);
+	Cylinder(glm::vec3 c, GLfloat radius, GLfloat length, GLuint definition = 100);
 	~Cylinder();
 	void makeCylinder();
-	void drawCylinder(int drawmode);
+	void drawCylinder(int drawmode, GLuint lod = 0);
+	void drawCylinderInstanced(int drawmode, const glm::mat4 *models, const glm::mat3 *normals, GLuint count, GLuint lod = 0);
+	void drawCylinderInstanced(int drawmode, const glm::mat4 *models, const glm::mat3 *normals, const glm::vec4 *colours,
+		GLuint count, GLuint lod = 0);
+
+	/* Add copies of the cylinder to this frame's batch instead of drawing them now, see MeshBuffer::drawBatch.
+	   The normal matrices are the eye space ones, as in MeshInstance */
+	void batchCylinder(const glm::mat4 &model, const glm::mat3 &normal, GLuint lod = 0);
+	void batchCylinderInstanced(const glm::mat4 *models, const glm::mat3 *normals, const glm::vec4 *colours, GLuint count,
+		GLuint lod = 0);
+
+	/* The cylinder's mesh in the shared mesh buffer at a level of detail, for its bounds */
+	MeshHandle getMesh(GLuint lod = 0) { return getGeometry(lod)->mesh; }
+
+	GLuint getNumLODs() const { return numlods; }
+	GLuint getLODDefinition(GLuint lod) const;
+	GLuint selectLOD(GLuint segments) const;
+
+	/* Instances and triangles drawn at each level of detail since the last reset */
+	const LODStats &getLODStats() const { return lodStats; }
+	void resetLODStats() { lodStats.reset(); }
 };
 
 #endif
@@ -0,0 +1,340 @@
+/* framecapture.cpp
+ Frame readback through pixel pack buffers and the image writing thread, see framecapture.h
+*/
+
+#include "framecapture.h"
+#include "wrapper_glfw.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+FrameCapture::FrameCapture()
+{
+	for (int i = 0; i < FRAME_CAPTURE_SLOTS; i++)
+	{
+		slots[i].buffer = 0;
+		slots[i].size = 0;
+		slots[i].fence = 0;
+	}
+	nextSlot = 0;
+	capturing = false;
+	format = CAPTURE_PNG;
+	frame = 0;
+	captured = skipped = 0;
+	quit = false;
+}
+
+
+/* The context has gone by now, so the buffers are left to it. finish() frees them while it is still current */
+FrameCapture::~FrameCapture()
+{
+	if (worker.joinable())
+	{
+		{
+			lock_guard<mutex> lock(queueMutex);
+			quit = true;
+		}
+		wake.notify_one();
+		worker.join();
+	}
+}
+
+
+void FrameCapture::start(const string &prefix, CaptureFormat format)
+{
+	this->prefix = prefix;
+	this->format = format;
+	frame = 0;
+	capturing = true;
+
+	if (!worker.joinable())
+	{
+		quit = false;
+		worker = thread(&FrameCapture::writeImages, this);
+	}
+}
+
+
+void FrameCapture::captureFrame(GLuint framebuffer, int width, int height)
+{
+	/* Pass on every frame that has arrived, without waiting for any */
+	for (int i = 0; i < FRAME_CAPTURE_SLOTS; i++)
+	{
+		if (slots[i].fence) collect(slots[i], false);
+	}
+	if (!capturing || width <= 0 || height <= 0) return;
+
+	Slot &slot = slots[nextSlot];
+	if (slot.fence)
+	{
+		skipped++;
+		frame++;
+		return;
+	}
+	nextSlot = (nextSlot + 1) % FRAME_CAPTURE_SLOTS;
+
+	GLsizeiptr size = (GLsizeiptr)width * height * 4;
+	if (slot.buffer == 0) glGenBuffers(1, &slot.buffer);
+	GLWrapper::state().bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	if (slot.size != size)
+	{
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		slot.size = size;
+	}
+
+	/* RGBA rows are always 4 byte aligned, and with a pack buffer bound the pointer is an offset into it */
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glReadBuffer(framebuffer ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	GLWrapper::state().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.frame = frame++;
+	slot.width = width;
+	slot.height = height;
+}
+
+
+/* If the slot's copy has finished, or wait is set, copy its pixels out and queue them for the worker */
+void FrameCapture::collect(Slot &slot, bool wait)
+{
+	GLenum result = glClientWaitSync(slot.fence, 0, 0);
+	while (wait && result == GL_TIMEOUT_EXPIRED)
+	{
+		result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+	}
+	if (result == GL_TIMEOUT_EXPIRED) return;
+
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+
+	Image image;
+	{
+		lock_guard<mutex> lock(queueMutex);
+		if (queue.size() >= FRAME_CAPTURE_QUEUE)
+		{
+			skipped++;
+			return;
+		}
+		if (!spare.empty())
+		{
+			image.pixels.swap(spare.back());
+			spare.pop_back();
+		}
+	}
+
+	char number[16];
+	snprintf(number, sizeof(number), "%06u", slot.frame);
+	image.path = prefix + number;
+	image.format = format;
+	image.frame = slot.frame;
+	image.width = slot.width;
+	image.height = slot.height;
+	image.pixels.resize(slot.size);
+
+	GLWrapper::state().bindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	const void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size, GL_MAP_READ_BIT);
+	if (mapped)
+	{
+		memcpy(&image.pixels[0], mapped, slot.size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	GLWrapper::state().bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	if (!mapped)
+	{
+		skipped++;
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(queueMutex);
+		queue.push_back(std::move(image));
+	}
+	wake.notify_one();
+	captured++;
+}
+
+
+void FrameCapture::finish()
+{
+	capturing = false;
+	for (int i = 0; i < FRAME_CAPTURE_SLOTS; i++)
+	{
+		if (slots[i].fence) collect(slots[i], true);
+		if (slots[i].buffer) glDeleteBuffers(1, &slots[i].buffer);
+		slots[i].buffer = 0;
+		slots[i].size = 0;
+	}
+
+	if (worker.joinable())
+	{
+		{
+			lock_guard<mutex> lock(queueMutex);
+			quit = true;
+		}
+		wake.notify_one();
+		worker.join();
+	}
+}
+
+
+/* CRC-32 as used by PNG chunks, and the Adler-32 checksum that ends a zlib stream */
+static unsigned int crc32(unsigned int crc, const unsigned char *data, size_t length)
+{
+	static unsigned int table[256];
+	static bool made = false;
+	if (!made)
+	{
+		for (unsigned int n = 0; n < 256; n++)
+		{
+			unsigned int c = n;
+			for (int k = 0; k < 8; k++)
+			{
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			}
+			table[n] = c;
+		}
+		made = true;
+	}
+
+	crc = ~crc;
+	for (size_t i = 0; i < length; i++)
+	{
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+
+static unsigned int adler32(unsigned int adler, const unsigned char *data, size_t length)
+{
+	unsigned int a = adler & 0xffff, b = adler >> 16;
+	for (size_t i = 0; i < length; i++)
+	{
+		a = (a + data[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	return (b << 16) | a;
+}
+
+
+static void putBigEndian(vector<unsigned char> &out, unsigned int value)
+{
+	out.push_back((unsigned char)(value >> 24));
+	out.push_back((unsigned char)(value >> 16));
+	out.push_back((unsigned char)(value >> 8));
+	out.push_back((unsigned char)value);
+}
+
+
+static void writeChunk(ofstream &file, const char *type, const vector<unsigned char> &data)
+{
+	vector<unsigned char> chunk;
+	putBigEndian(chunk, (unsigned int)data.size());
+	chunk.insert(chunk.end(), type, type + 4);
+	chunk.insert(chunk.end(), data.begin(), data.end());
+	putBigEndian(chunk, crc32(0, &chunk[4], chunk.size() - 4));
+	file.write((const char*)&chunk[0], chunk.size());
+}
+
+
+/* rows is the filtered image, each row a filter type byte and the row's RGB bytes. It is stored in a zlib
+   stream of uncompressed deflate blocks of up to 65535 bytes each */
+static bool writePNG(const string &path, int width, int height, const vector<unsigned char> &rows)
+{
+	ofstream file(path.c_str(), ios::binary);
+	if (!file.is_open()) return false;
+
+	static const unsigned char signature[8] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+	file.write((const char*)signature, sizeof(signature));
+
+	vector<unsigned char> header;
+	putBigEndian(header, width);
+	putBigEndian(header, height);
+	header.push_back(8);		// Bits per channel
+	header.push_back(2);		// RGB
+	header.push_back(0);		// Deflate
+	header.push_back(0);		// Adaptive filtering
+	header.push_back(0);		// Not interlaced
+	writeChunk(file, "IHDR", header);
+
+	vector<unsigned char> data;
+	data.reserve(rows.size() + rows.size() / 65535 * 5 + 16);
+	data.push_back(0x78);
+	data.push_back(0x01);
+	size_t position = 0;
+	do
+	{
+		size_t length = std::min(rows.size() - position, (size_t)65535);
+		bool last = position + length == rows.size();
+		data.push_back(last ? 1 : 0);
+		data.push_back((unsigned char)length);
+		data.push_back((unsigned char)(length >> 8));
+		data.push_back((unsigned char)~length);
+		data.push_back((unsigned char)(~length >> 8));
+		data.insert(data.end(), rows.begin() + position, rows.begin() + position + length);
+		position += length;
+	} while (position < rows.size());
+	putBigEndian(data, adler32(1, &rows[0], rows.size()));
+	writeChunk(file, "IDAT", data);
+
+	writeChunk(file, "IEND", vector<unsigned char>());
+	return file.good();
+}
+
+
+/* The worker thread. Converts each queued image to RGB rows, top first, and writes it */
+void FrameCapture::writeImages()
+{
+	vector<unsigned char> rows;
+	for (;;)
+	{
+		Image image;
+		{
+			unique_lock<mutex> lock(queueMutex);
+			wake.wait(lock, [this]() { return quit || !queue.empty(); });
+			if (queue.empty()) return;
+			image = std::move(queue.front());
+			queue.pop_front();
+		}
+
+		bool png = image.format == CAPTURE_PNG;
+		size_t rowSize = (size_t)image.width * 3 + (png ? 1 : 0);
+		rows.resize(rowSize * image.height);
+		for (int y = 0; y < image.height; y++)
+		{
+			const unsigned char *source = &image.pixels[(size_t)(image.height - 1 - y) * image.width * 4];
+			unsigned char *row = &rows[y * rowSize];
+			if (png) *row++ = 0;	// No filter
+			for (int x = 0; x < image.width; x++)
+			{
+				row[x * 3] = source[x * 4];
+				row[x * 3 + 1] = source[x * 4 + 1];
+				row[x * 3 + 2] = source[x * 4 + 2];
+			}
+		}
+
+		bool written;
+		if (png)
+		{
+			written = writePNG(image.path + ".png", image.width, image.height, rows);
+		}
+		else
+		{
+			char size[32];
+			snprintf(size, sizeof(size), "_%dx%d.rgb", image.width, image.height);
+			ofstream file((image.path + size).c_str(), ios::binary);
+			file.write((const char*)&rows[0], rows.size());
+			written = file.good();
+		}
+		if (!written) cerr << "FrameCapture: couldn't write frame " << image.frame << " to " << image.path << endl;
+
+		lock_guard<mutex> lock(queueMutex);
+		spare.push_back(std::move(image.pixels));
+	}
+}
@@ -0,0 +1,99 @@
+/* framecapture.h
+ Records rendered frames to image files without stalling the pipeline. Reading the framebuffer
+ straight into memory with glReadPixels makes the CPU wait for the GPU to finish the frame. Here
+ each captured frame is read into one of a ring of FRAME_CAPTURE_SLOTS pixel pack buffers instead,
+ which returns at once, and a fence marks when the copy is done. The buffer is only mapped once
+ its fence has passed, normally while the frame two after it is being rendered. A frame whose
+ slot is still busy when it comes round again is skipped rather than waited for.
+
+ The mapped pixels are copied out and handed to a worker thread, which flips them the right way
+ up and writes them as PNG or raw files. If the worker falls more than FRAME_CAPTURE_QUEUE frames
+ behind, newer frames are skipped too, so a slow disk costs captured frames, never frame rate.
+ Skipped frames are counted.
+
+ PNG files are RGB with the image data stored, not compressed, so they are quick to write and
+ need no compression library. Raw files are the RGB bytes, top row first, with the size in the name.
+*/
+
+#pragma once
+
+#include <glload/gl_4_0.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+const int FRAME_CAPTURE_SLOTS = 3;
+const size_t FRAME_CAPTURE_QUEUE = 8;
+
+enum CaptureFormat
+{
+	CAPTURE_PNG,
+	CAPTURE_RAW
+};
+
+class FrameCapture
+{
+public:
+	FrameCapture();
+	~FrameCapture();
+
+	/* Capture every frame from now on, as files named prefix plus the frame number. The prefix can include a
+	   directory, which must exist */
+	void start(const std::string &prefix, CaptureFormat format = CAPTURE_PNG);
+
+	/* Stop capturing new frames. Frames already read back are still written */
+	void stop() { capturing = false; }
+	bool isCapturing() const { return capturing; }
+
+	/* Start reading back the colour buffer of the framebuffer, 0 for the window's back buffer, and pass on any
+	   earlier frames that have arrived. Needs a current context. The event loop calls this before swapping */
+	void captureFrame(GLuint framebuffer, int width, int height);
+
+	/* Wait for every frame read back so far to be written, then free the buffers. Needs a current context.
+	   The event loop calls this when it exits */
+	void finish();
+
+	unsigned int getFramesCaptured() const { return captured; }
+	unsigned int getFramesSkipped() const { return skipped; }
+
+private:
+	struct Slot
+	{
+		GLuint buffer;
+		GLsizeiptr size;
+		GLsync fence;			// Zero when the slot is free
+		unsigned int frame;
+		int width, height;
+	};
+
+	struct Image
+	{
+		std::string path;
+		CaptureFormat format;
+		unsigned int frame;
+		int width, height;
+		std::vector<unsigned char> pixels;	// RGBA, bottom row first as read from OpenGL
+	};
+
+	void collect(Slot &slot, bool wait);
+	void writeImages();
+
+	Slot slots[FRAME_CAPTURE_SLOTS];
+	int nextSlot;
+	bool capturing;
+	std::string prefix;
+	CaptureFormat format;
+	unsigned int frame;
+	unsigned int captured, skipped;
+
+	/* Images waiting for the worker, and the buffers of written ones kept for reuse */
+	std::thread worker;
+	std::mutex queueMutex;
+	std::condition_variable wake;
+	std::deque<Image> queue;
+	std::vector<std::vector<unsigned char> > spare;
+	bool quit;
+};
@@ -0,0 +1,181 @@
+/* framepacer.cpp
+ Swap interval control, the frame rate limiter and frame time statistics, see framepacer.h
+*/
+
+#include "framepacer.h"
+#include <thread>
+#include <cmath>
+#include <algorithm>
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+/* Windows sleeps in steps of its timer period, 15.6ms by default, so the period is shortened to 1ms
+   while frames are being limited */
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+using namespace std;
+
+/* The limiter starts by spinning for the last 1ms before a deadline, then adjusts to the oversleeps it sees.
+   Each new oversleep moves the running estimates 1/16 of the way towards it */
+const double INITIAL_OVERSLEEP = 1000.0;
+const double MIN_SLEEP_MARGIN = 100.0;
+const double OVERSLEEP_WEIGHT = 1.0 / 16.0;
+
+FramePacer::FramePacer()
+{
+	targetFPS = 0;
+	period = Clock::duration::zero();
+	swapMode = SWAP_VSYNC;
+	scheduled = started = false;
+	oversleepMean = INITIAL_OVERSLEEP;
+	oversleepVariance = 0;
+	nextFrame = 0;
+	frameTimes.reserve(FRAME_HISTORY);
+}
+
+
+FramePacer::~FramePacer()
+{
+#ifdef _WIN32
+	if (targetFPS > 0) timeEndPeriod(1);
+#endif
+}
+
+
+void FramePacer::setTargetFPS(double fps)
+{
+	if (fps < 0) fps = 0;
+
+#ifdef _WIN32
+	if (fps > 0 && targetFPS <= 0) timeBeginPeriod(1);
+	if (fps <= 0 && targetFPS > 0) timeEndPeriod(1);
+#endif
+
+	targetFPS = fps;
+	period = fps > 0 ? chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / fps)) : Clock::duration::zero();
+	scheduled = false;
+}
+
+
+/* An interval of -1 asks for adaptive synchronisation */
+void FramePacer::setSwapMode(SwapMode mode)
+{
+	if (mode == SWAP_ADAPTIVE && !glfwExtensionSupported("WGL_EXT_swap_control_tear") &&
+		!glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+	{
+		mode = SWAP_VSYNC;
+	}
+
+	int interval = 0;
+	if (mode == SWAP_VSYNC) interval = 1;
+	if (mode == SWAP_ADAPTIVE) interval = -1;
+	glfwSwapInterval(interval);
+	swapMode = mode;
+}
+
+
+void FramePacer::waitForDeadline()
+{
+	if (targetFPS <= 0) return;
+
+	Clock::time_point now = Clock::now();
+	if (!scheduled)
+	{
+		deadline = now;
+		scheduled = true;
+		return;
+	}
+
+	deadline += period;
+	if (now > deadline + period)
+	{
+		deadline = now;
+		return;
+	}
+
+	/* Sleep until the margin before the deadline, then spin */
+	while (now < deadline)
+	{
+		double margin = std::max(oversleepMean + 2.0 * sqrt(oversleepVariance), MIN_SLEEP_MARGIN);
+		double remaining = chrono::duration<double, micro>(deadline - now).count();
+		if (remaining > margin)
+		{
+			chrono::duration<double, micro> wanted(remaining - margin);
+			this_thread::sleep_for(wanted);
+			Clock::time_point woken = Clock::now();
+			double overslept = chrono::duration<double, micro>(woken - now).count() - wanted.count();
+			double difference = overslept - oversleepMean;
+			oversleepMean += difference * OVERSLEEP_WEIGHT;
+			oversleepVariance += (difference * difference - oversleepVariance) * OVERSLEEP_WEIGHT;
+			now = woken;
+		}
+		else
+		{
+			now = Clock::now();
+		}
+	}
+}
+
+
+void FramePacer::endFrame()
+{
+	Clock::time_point now = Clock::now();
+	if (started)
+	{
+		double milliseconds = chrono::duration<double, milli>(now - lastSwap).count();
+		if (frameTimes.size() < FRAME_HISTORY)
+		{
+			frameTimes.push_back(milliseconds);
+		}
+		else
+		{
+			frameTimes[nextFrame] = milliseconds;
+		}
+		nextFrame = (nextFrame + 1) % FRAME_HISTORY;
+	}
+	lastSwap = now;
+	started = true;
+}
+
+
+FrameTimeStats FramePacer::getStats() const
+{
+	FrameTimeStats stats;
+	stats.frames = (unsigned int)frameTimes.size();
+	stats.mean = stats.standardDeviation = stats.minimum = stats.maximum = 0;
+	stats.missed = 0;
+	if (frameTimes.empty()) return stats;
+
+	double sum = 0;
+	stats.minimum = stats.maximum = frameTimes[0];
+	for (size_t i = 0; i < frameTimes.size(); i++)
+	{
+		sum += frameTimes[i];
+		stats.minimum = std::min(stats.minimum, frameTimes[i]);
+		stats.maximum = std::max(stats.maximum, frameTimes[i]);
+	}
+	stats.mean = sum / frameTimes.size();
+
+	double variance = 0;
+	double late = targetFPS > 0 ? 1500.0 / targetFPS : 0;
+	for (size_t i = 0; i < frameTimes.size(); i++)
+	{
+		variance += (frameTimes[i] - stats.mean) * (frameTimes[i] - stats.mean);
+		if (targetFPS > 0 && frameTimes[i] > late) stats.missed++;
+	}
+	stats.standardDeviation = sqrt(variance / frameTimes.size());
+	return stats;
+}
+
+
+void FramePacer::resetStats()
+{
+	frameTimes.clear();
+	nextFrame = 0;
+	started = false;
+}
@@ -0,0 +1,83 @@
+/* framepacer.h
+ Paces the event loop's frames. The swap interval can be immediate, synchronised to the display's
+ vertical blank, or adaptive (synchronised, but a late frame is shown straight away with tearing
+ rather than waiting for the next blank). Adaptive needs the swap control tear extension and falls
+ back to synchronised without it.
+
+ Independently of the swap interval, frames can be limited to a target rate. The limiter waits for
+ each frame's deadline on the steady clock before the buffers are swapped. It sleeps while the
+ deadline is further away than the OS usually oversleeps, then spins for the rest, so it neither
+ burns a core nor usually wakes late. The margin is the running mean of the oversleeps plus two
+ standard deviations, so a rare long oversleep only makes that one frame late. Deadlines are a
+ whole number of frame periods apart, so a slow frame doesn't push every later frame back. After
+ falling more than a frame behind the limiter starts again from the current time instead of
+ rushing to catch up.
+
+ The time between swaps is kept for the last FRAME_HISTORY frames, to report the mean, standard
+ deviation, extremes and missed deadlines.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+enum SwapMode
+{
+	SWAP_IMMEDIATE,
+	SWAP_VSYNC,
+	SWAP_ADAPTIVE
+};
+
+const unsigned int FRAME_HISTORY = 240;
+
+/* Times in milliseconds, over the frames in the history */
+struct FrameTimeStats
+{
+	unsigned int frames;
+	double mean;
+	double standardDeviation;
+	double minimum;
+	double maximum;
+	unsigned int missed;	// Frames that took more than one and a half target periods, when the rate is limited
+};
+
+class FramePacer
+{
+public:
+	FramePacer();
+	~FramePacer();
+
+	/* Frames per second to limit to, or 0 for no limit */
+	void setTargetFPS(double fps);
+	double getTargetFPS() const { return targetFPS; }
+
+	/* Needs a current context. The mode actually in use can differ, see getSwapMode */
+	void setSwapMode(SwapMode mode);
+	SwapMode getSwapMode() const { return swapMode; }
+
+	/* Wait for this frame's deadline. Call after rendering and before swapping the buffers */
+	void waitForDeadline();
+
+	/* Record the frame's time. Call after swapping the buffers */
+	void endFrame();
+
+	FrameTimeStats getStats() const;
+	void resetStats();
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	double targetFPS;
+	Clock::duration period;
+	SwapMode swapMode;
+
+	Clock::time_point deadline;
+	bool scheduled;					// False until the first deadline, and after the target changes
+	Clock::time_point lastSwap;
+	bool started;					// False until the first swap
+	double oversleepMean, oversleepVariance;	// Microseconds, running estimates for the sleep margin
+
+	std::vector<double> frameTimes;	// Milliseconds, a ring of FRAME_HISTORY frames
+	unsigned int nextFrame;
+};
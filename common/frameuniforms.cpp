@@ -0,0 +1,48 @@
+/* frameuniforms.cpp
+ Per-frame uniform buffer shared by all shader programs, see frameuniforms.h
+*/
+
+#include "frameuniforms.h"
+
+FrameUniformBuffer::FrameUniformBuffer()
+{
+	buffer = 0;
+	uploaded = 0;
+}
+
+
+/* Create the buffer and attach it to the binding point. This only has to be done once */
+void FrameUniformBuffer::create()
+{
+	glGenBuffers(1, &buffer);
+	GLWrapper::state().bindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_STREAM_DRAW);
+	GLWrapper::state().bindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, buffer);
+}
+
+
+/* Upload the frame's constants in one call. Respecifying the whole buffer lets the driver give us fresh
+   storage instead of waiting for the previous frame's draws to finish reading it */
+void FrameUniformBuffer::update(const FrameUniforms &data)
+{
+	GLWrapper::state().bindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), &data, GL_STREAM_DRAW);
+	uploaded += sizeof(FrameUniforms);
+}
+
+
+static void bindUniformBlock(GLuint program, const char *name, GLuint binding)
+{
+	GLuint block = glGetUniformBlockIndex(program, name);
+	if (block != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(program, block, binding);
+	}
+}
+
+
+void bindUniformBlocks(GLuint program)
+{
+	bindUniformBlock(program, FRAME_UNIFORMS_BLOCK, FRAME_UNIFORMS_BINDING);
+	bindUniformBlock(program, DRAW_UNIFORMS_BLOCK, DRAW_UNIFORMS_BINDING);
+}
@@ -0,0 +1,101 @@
+/* frameuniforms.h
+ Per-frame shader constants held in one uniform buffer that every program shares, and the layout of
+ the per-draw constants that are streamed through GLWrapper::constants().
+ FrameUniforms mirrors this std140 block, which shaders declare to use it:
+
+	layout(std140) uniform FrameUniforms
+	{
+		mat4 view;
+		mat4 projection;
+		vec4 lightpos;
+		uint colourmode;
+		uint attenuationmode;
+	};
+
+ and DrawUniforms mirrors this one:
+
+	layout(std140) uniform DrawUniforms
+	{
+		mat4 model;
+		mat3 normalmatrix;
+		uint emitmode;
+		uint instanced;
+	};
+
+ GLWrapper::LoadShader and BuildShaderProgram attach the blocks to FRAME_UNIFORMS_BINDING and
+ DRAW_UNIFORMS_BINDING in each program they link, so the frame buffer only needs binding once and
+ stays bound when the program changes.
+*/
+
+#pragma once
+
+#include "wrapper_glfw.h"
+#include <cstddef>
+#include <glm/glm.hpp>
+
+const GLuint FRAME_UNIFORMS_BINDING = 0;
+const char *const FRAME_UNIFORMS_BLOCK = "FrameUniforms";
+const GLuint DRAW_UNIFORMS_BINDING = 1;
+const char *const DRAW_UNIFORMS_BLOCK = "DrawUniforms";
+
+/* C++ mirror of the block. std140 puts each mat4 and vec4 on a 16 byte boundary and rounds the block
+   up to a multiple of 16, so any change here must keep the offsets checked below in step with the shaders */
+struct FrameUniforms
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec4 lightpos;
+	GLuint colourmode;
+	GLuint attenuationmode;
+	GLuint padding[2];
+};
+
+static_assert(offsetof(FrameUniforms, view) == 0, "FrameUniforms.view must be at std140 offset 0");
+static_assert(offsetof(FrameUniforms, projection) == 64, "FrameUniforms.projection must be at std140 offset 64");
+static_assert(offsetof(FrameUniforms, lightpos) == 128, "FrameUniforms.lightpos must be at std140 offset 128");
+static_assert(offsetof(FrameUniforms, colourmode) == 144, "FrameUniforms.colourmode must be at std140 offset 144");
+static_assert(offsetof(FrameUniforms, attenuationmode) == 148, "FrameUniforms.attenuationmode must be at std140 offset 148");
+static_assert(sizeof(FrameUniforms) == 160, "FrameUniforms must be a multiple of 16 bytes, as std140 rounds the block up");
+
+/* C++ mirror of the per-draw block. A std140 mat3 is stored as three columns each padded to a vec4 */
+struct DrawUniforms
+{
+	glm::mat4 model;
+	glm::vec4 normalmatrix[3];
+	GLuint emitmode;
+	GLuint instanced;
+	GLuint padding[2];
+
+	void setNormalMatrix(const glm::mat3 &m)
+	{
+		for (int i = 0; i < 3; i++) normalmatrix[i] = glm::vec4(m[i], 0);
+	}
+};
+
+static_assert(offsetof(DrawUniforms, model) == 0, "DrawUniforms.model must be at std140 offset 0");
+static_assert(offsetof(DrawUniforms, normalmatrix) == 64, "DrawUniforms.normalmatrix must be at std140 offset 64");
+static_assert(offsetof(DrawUniforms, emitmode) == 112, "DrawUniforms.emitmode must be at std140 offset 112");
+static_assert(offsetof(DrawUniforms, instanced) == 116, "DrawUniforms.instanced must be at std140 offset 116");
+static_assert(sizeof(DrawUniforms) == 128, "DrawUniforms must be a multiple of 16 bytes, as std140 rounds the block up");
+
+/* The uniform buffer holding the current frame's FrameUniforms */
+class FrameUniformBuffer
+{
+public:
+	FrameUniformBuffer();
+
+	void create();
+	void update(const FrameUniforms &data);
+
+	GLuint getBuffer() const { return buffer; }
+
+	/* Bytes uploaded by update() since the start */
+	unsigned long long getBytesUploaded() const { return uploaded; }
+
+private:
+	GLuint buffer;
+	unsigned long long uploaded;
+};
+
+/* Attach a linked program's FrameUniforms and DrawUniforms blocks, if it has them, to their binding points */
+void bindUniformBlocks(GLuint program);
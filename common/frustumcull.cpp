@@ -0,0 +1,181 @@
+/* frustumcull.cpp
+ Frustum plane extraction and the scalar and SSE bounds tests, see frustumcull.h
+*/
+
+#include "frustumcull.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define FRUSTUMCULL_X86 1
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+using namespace glm;
+
+/* Each plane is the sum or difference of the last row of the matrix and one of the others, because a
+   point is inside when -w <= x, y, z <= w in clip space */
+Frustum::Frustum(const mat4 &viewProjection)
+{
+	vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+
+	planes[0] = rows[3] + rows[0];	// Left
+	planes[1] = rows[3] - rows[0];	// Right
+	planes[2] = rows[3] + rows[1];	// Bottom
+	planes[3] = rows[3] - rows[1];	// Top
+	planes[4] = rows[3] + rows[2];	// Near
+	planes[5] = rows[3] - rows[2];	// Far
+
+	for (int i = 0; i < 6; i++)
+	{
+		planes[i] /= length(vec3(planes[i]));
+	}
+}
+
+
+FrustumCuller::FrustumCuller()
+{
+	clear();
+}
+
+
+void FrustumCuller::clear()
+{
+	centreX.clear(); centreY.clear(); centreZ.clear();
+	extentX.clear(); extentY.clear(); extentZ.clear();
+	radius.clear();
+	count = 0;
+	stats.tested = stats.drawn = stats.culled = 0;
+}
+
+
+GLuint FrustumCuller::add(const MeshBounds &bounds, const mat4 &model)
+{
+	vec3 centre = vec3(model * vec4(bounds.centre, 1.f));
+
+	/* The box is rotated and scaled by the model matrix, so use the world axis aligned box that encloses it.
+	   The sphere's radius grows by the largest scale on any axis */
+	vec3 extent;
+	for (int i = 0; i < 3; i++)
+	{
+		extent[i] = fabs(model[0][i]) * bounds.extents.x + fabs(model[1][i]) * bounds.extents.y + fabs(model[2][i]) * bounds.extents.z;
+	}
+	float scale = std::max(length(vec3(model[0])), std::max(length(vec3(model[1])), length(vec3(model[2]))));
+
+	centreX.push_back(centre.x); centreY.push_back(centre.y); centreZ.push_back(centre.z);
+	extentX.push_back(extent.x); extentY.push_back(extent.y); extentZ.push_back(extent.z);
+	radius.push_back(bounds.radius * scale);
+	return count++;
+}
+
+
+/* How far the object reaches back towards a plane is the smaller of its sphere radius and the projection of
+   its box onto the plane normal, so the object is outside when its centre is further behind than that */
+static void cullScalar(const Frustum &frustum, const float *cx, const float *cy, const float *cz,
+	const float *ex, const float *ey, const float *ez, const float *r, GLuint count, unsigned char *visible)
+{
+	for (GLuint i = 0; i < count; i++)
+	{
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; p++)
+		{
+			const vec4 &plane = frustum.planes[p];
+			float distance = plane.x * cx[i] + plane.y * cy[i] + plane.z * cz[i] + plane.w;
+			float boxReach = fabs(plane.x) * ex[i] + fabs(plane.y) * ey[i] + fabs(plane.z) * ez[i];
+			outside = distance + std::min(r[i], boxReach) < 0.f;
+		}
+		visible[i] = !outside;
+	}
+}
+
+
+#ifdef FRUSTUMCULL_X86
+/* The same test on 4 objects at a time. count must be a multiple of 4 */
+static void cullSSE(const Frustum &frustum, const float *cx, const float *cy, const float *cz,
+	const float *ex, const float *ey, const float *ez, const float *r, GLuint count, unsigned char *visible)
+{
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+	for (int p = 0; p < 6; p++)
+	{
+		nx[p] = _mm_set1_ps(frustum.planes[p].x);
+		ny[p] = _mm_set1_ps(frustum.planes[p].y);
+		nz[p] = _mm_set1_ps(frustum.planes[p].z);
+		nw[p] = _mm_set1_ps(frustum.planes[p].w);
+		ax[p] = _mm_and_ps(nx[p], signMask);
+		ay[p] = _mm_and_ps(ny[p], signMask);
+		az[p] = _mm_and_ps(nz[p], signMask);
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	for (GLuint i = 0; i < count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(cx + i), y = _mm_loadu_ps(cy + i), z = _mm_loadu_ps(cz + i);
+		__m128 bx = _mm_loadu_ps(ex + i), by = _mm_loadu_ps(ey + i), bz = _mm_loadu_ps(ez + i);
+		__m128 sphere = _mm_loadu_ps(r + i);
+
+		__m128 outside = zero;
+		for (int p = 0; p < 6; p++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], x), _mm_mul_ps(ny[p], y)),
+				_mm_add_ps(_mm_mul_ps(nz[p], z), nw[p]));
+			__m128 boxReach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], bx), _mm_mul_ps(ay[p], by)), _mm_mul_ps(az[p], bz));
+			__m128 reach = _mm_min_ps(sphere, boxReach);
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), zero));
+		}
+
+		int mask = _mm_movemask_ps(outside);
+		visible[i] = !(mask & 1);
+		visible[i + 1] = !(mask & 2);
+		visible[i + 2] = !(mask & 4);
+		visible[i + 3] = !(mask & 8);
+	}
+}
+#endif
+
+
+void FrustumCuller::cull(const mat4 &viewProjection, TransformISA isa)
+{
+	Frustum frustum(viewProjection);
+
+	/* Pad to a whole number of SSE blocks. The padding objects are tested but never looked at */
+	GLuint padded = (count + 3) & ~3u;
+	centreX.resize(padded); centreY.resize(padded); centreZ.resize(padded);
+	extentX.resize(padded); extentY.resize(padded); extentZ.resize(padded);
+	radius.resize(padded);
+	visible.resize(padded);
+
+	if (padded > 0)
+	{
+#ifdef FRUSTUMCULL_X86
+		if (isa != TRANSFORM_SCALAR)
+		{
+			cullSSE(frustum, &centreX[0], &centreY[0], &centreZ[0], &extentX[0], &extentY[0], &extentZ[0], &radius[0],
+				padded, &visible[0]);
+		}
+		else
+#endif
+		{
+			cullScalar(frustum, &centreX[0], &centreY[0], &centreZ[0], &extentX[0], &extentY[0], &extentZ[0], &radius[0],
+				count, &visible[0]);
+		}
+	}
+
+	// Drop the padding again so that add() keeps appending after the real objects
+	centreX.resize(count); centreY.resize(count); centreZ.resize(count);
+	extentX.resize(count); extentY.resize(count); extentZ.resize(count);
+	radius.resize(count);
+
+	stats.tested = count;
+	stats.drawn = 0;
+	for (GLuint i = 0; i < count; i++)
+	{
+		stats.drawn += visible[i];
+	}
+	stats.culled = count - stats.drawn;
+}
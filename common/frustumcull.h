@@ -0,0 +1,59 @@
+/* frustumcull.h
+ View frustum culling of objects by their bounds. Each object's mesh bounds are moved into world
+ space as they are added, then cull() tests all of them against the six planes of the view
+ frustum and marks which are at least partly inside.
+
+ The world bounds are held in structure-of-arrays form, padded to a multiple of 4, so SSE tests
+ 4 objects against each plane at once. An object is culled when its bounding sphere or its box is
+ entirely behind any plane, using whichever of the two reaches less far towards that plane.
+*/
+
+#pragma once
+
+#include "meshbuffer.h"
+#include "cpufeatures.h"
+#include <vector>
+#include <glm/glm.hpp>
+
+/* Objects tested and how many were kept and culled, for the last cull() */
+struct CullStats
+{
+	GLuint tested;
+	GLuint drawn;
+	GLuint culled;
+};
+
+/* The six planes of the frustum of a projection * view matrix as (normal, distance), with the normals
+   pointing inwards and normalised so that dot(plane, vec4(p, 1)) is the distance of p inside the plane */
+struct Frustum
+{
+	glm::vec4 planes[6];
+
+	Frustum(const glm::mat4 &viewProjection);
+};
+
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+
+	void clear();
+
+	/* Add an object with the given mesh bounds and model matrix, returning its index */
+	GLuint add(const MeshBounds &bounds, const glm::mat4 &model);
+
+	void cull(const glm::mat4 &viewProjection, TransformISA isa = getBestTransformISA());
+
+	bool isVisible(GLuint i) const { return visible[i] != 0; }
+	GLuint size() const { return count; }
+	CullStats getStats() const { return stats; }
+
+private:
+	// World space box centre (which is also the sphere centre), box half extents and sphere radius
+	std::vector<float> centreX, centreY, centreZ;
+	std::vector<float> extentX, extentY, extentZ;
+	std::vector<float> radius;
+	std::vector<unsigned char> visible;
+	GLuint count;
+	CullStats stats;
+};
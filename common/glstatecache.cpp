@@ -0,0 +1,157 @@
+/* glstatecache.cpp
+ Redundant OpenGL state elimination, see glstatecache.h
+*/
+
+#include "glstatecache.h"
+#include <cstring>
+
+using namespace std;
+
+GLStateCache::GLStateCache()
+{
+	currentFrame.issued = currentFrame.elided = 0;
+	lastFrame = currentFrame;
+	invalidate();
+}
+
+
+/* Forget everything that has been shadowed so that the next call of each kind is issued */
+void GLStateCache::invalidate()
+{
+	programKnown = vaoKnown = polygonModeKnown = pointSizeKnown = clearColorKnown = false;
+	program = vao = 0;
+	polygonModeValue = 0;
+	pointSizeValue = 0;
+	buffers.clear();
+	enables.clear();
+}
+
+
+/* Start counting a new frame, keeping the counts of the one just finished */
+void GLStateCache::beginFrame()
+{
+	lastFrame = currentFrame;
+	currentFrame.issued = currentFrame.elided = 0;
+}
+
+
+/* Record whether a call was issued or elided and return changed so callers can use it directly */
+bool GLStateCache::count(bool changed)
+{
+	if (changed)
+		currentFrame.issued++;
+	else
+		currentFrame.elided++;
+	return changed;
+}
+
+
+void GLStateCache::useProgram(GLuint program)
+{
+	if (count(!programKnown || this->program != program))
+	{
+		glUseProgram(program);
+		this->program = program;
+		programKnown = true;
+	}
+}
+
+
+void GLStateCache::bindVertexArray(GLuint vao)
+{
+	if (count(!vaoKnown || this->vao != vao))
+	{
+		glBindVertexArray(vao);
+		this->vao = vao;
+		vaoKnown = true;
+
+		// The element array binding belongs to the vertex array object so it changes with it
+		buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+	}
+}
+
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer)
+{
+	map<GLenum, GLuint>::iterator found = buffers.find(target);
+	if (count(found == buffers.end() || found->second != buffer))
+	{
+		glBindBuffer(target, buffer);
+		buffers[target] = buffer;
+	}
+}
+
+
+/* Indexed bindings are always issued, they normally change with every draw. They also bind the buffer to the
+   generic binding point for the target, so that is recorded */
+void GLStateCache::bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	count(true);
+	glBindBufferBase(target, index, buffer);
+	buffers[target] = buffer;
+}
+
+
+void GLStateCache::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	count(true);
+	glBindBufferRange(target, index, buffer, offset, size);
+	buffers[target] = buffer;
+}
+
+
+/* Core profile only allows GL_FRONT_AND_BACK so only the mode is shadowed */
+void GLStateCache::polygonMode(GLenum mode)
+{
+	if (count(!polygonModeKnown || polygonModeValue != mode))
+	{
+		glPolygonMode(GL_FRONT_AND_BACK, mode);
+		polygonModeValue = mode;
+		polygonModeKnown = true;
+	}
+}
+
+
+void GLStateCache::pointSize(GLfloat size)
+{
+	if (count(!pointSizeKnown || pointSizeValue != size))
+	{
+		glPointSize(size);
+		pointSizeValue = size;
+		pointSizeKnown = true;
+	}
+}
+
+
+void GLStateCache::enable(GLenum cap)
+{
+	map<GLenum, bool>::iterator found = enables.find(cap);
+	if (count(found == enables.end() || !found->second))
+	{
+		glEnable(cap);
+		enables[cap] = true;
+	}
+}
+
+
+void GLStateCache::disable(GLenum cap)
+{
+	map<GLenum, bool>::iterator found = enables.find(cap);
+	if (count(found == enables.end() || found->second))
+	{
+		glDisable(cap);
+		enables[cap] = false;
+	}
+}
+
+
+void GLStateCache::clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+	GLfloat colour[4] = { red, green, blue, alpha };
+	if (count(!clearColorKnown || memcmp(clearColorValue, colour, sizeof(colour)) != 0))
+	{
+		glClearColor(red, green, blue, alpha);
+		memcpy(clearColorValue, colour, sizeof(colour));
+		clearColorKnown = true;
+	}
+}
@@ -0,0 +1,61 @@
+/* glstatecache.h
+ Shadows the OpenGL state that the example objects change on every draw (program, buffer and
+ vertex array bindings, polygon mode, point size, enable bits and clear colour) and only passes a
+ call on to OpenGL when it would change something. Uniforms aren't shadowed, they are all in the
+ uniform buffers of frameuniforms.h.
+ Counts the calls issued and elided each frame so the saving can be seen.
+
+ The cache only knows about changes made through it. If OpenGL state is changed directly, or a
+ program, buffer or vertex array is deleted and its name reused, call invalidate() so that the
+ next call of each kind is always issued.
+*/
+
+#pragma once
+
+#include <glload/gl_4_0.h>
+#include <map>
+
+/* Calls passed to OpenGL and calls skipped because the state was already set */
+struct GLStateStats
+{
+	unsigned int issued;
+	unsigned int elided;
+};
+
+class GLStateCache
+{
+public:
+	GLStateCache();
+
+	void invalidate();
+	void beginFrame();
+
+	/* Counts for the last complete frame, and for the frame in progress */
+	GLStateStats getFrameStats() const { return lastFrame; }
+	GLStateStats getCurrentStats() const { return currentFrame; }
+
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vao);
+	void bindBuffer(GLenum target, GLuint buffer);
+	void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+	void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+	void polygonMode(GLenum mode);
+	void pointSize(GLfloat size);
+	void enable(GLenum cap);
+	void disable(GLenum cap);
+	void clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+
+private:
+	bool count(bool changed);
+
+	bool programKnown, vaoKnown, polygonModeKnown, pointSizeKnown, clearColorKnown;
+	GLuint program;
+	GLuint vao;
+	GLenum polygonModeValue;
+	GLfloat pointSizeValue;
+	GLfloat clearColorValue[4];
+	std::map<GLenum, GLuint> buffers;
+	std::map<GLenum, bool> enables;
+
+	GLStateStats currentFrame, lastFrame;
+};
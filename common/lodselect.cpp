@@ -0,0 +1,58 @@
+/* lodselect.cpp
+ Screen size level of detail selection, see lodselect.h
+*/
+
+#include "lodselect.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+const GLfloat LOD_MIN_PIXEL_ERROR = 0.05f;
+const GLuint LOD_MAX_SEGMENTS = 1 << 16;
+
+LODSelector::LODSelector(GLfloat pixelError)
+{
+	view = mat4(1.f);
+	pixelsPerUnit = 1.f;
+	setPixelError(pixelError);
+}
+
+
+/* projection[1][1] is the cotangent of half the vertical field of view, which spans viewportHeight / 2 pixels */
+void LODSelector::setView(const mat4 &view, const mat4 &projection, GLfloat viewportHeight)
+{
+	this->view = view;
+	pixelsPerUnit = projection[1][1] * viewportHeight * 0.5f;
+}
+
+
+/* A sphere of radius r at distance d subtends a half angle whose tangent is r / sqrt(d^2 - r^2). The
+   radius grows with the largest scale in the model matrix */
+GLfloat LODSelector::getPixelRadius(const MeshBounds &bounds, const mat4 &model) const
+{
+	vec3 centre = vec3(view * model * vec4(bounds.centre, 1.f));
+	GLfloat scale = std::max(length(vec3(model[0])), std::max(length(vec3(model[1])), length(vec3(model[2]))));
+	GLfloat radius = bounds.radius * scale;
+	GLfloat distance = -centre.z;
+
+	if (distance <= radius) return (GLfloat)LOD_MAX_SEGMENTS;
+	return radius / sqrt(distance * distance - radius * radius) * pixelsPerUnit;
+}
+
+
+GLuint LODSelector::getSegments(GLfloat pixelRadius) const
+{
+	if (pixelRadius <= pixelError) return 3;
+
+	GLfloat segments = 3.141592653589f / acos(1.f - pixelError / pixelRadius);
+	if (segments >= (GLfloat)LOD_MAX_SEGMENTS) return LOD_MAX_SEGMENTS;
+	return std::max(3u, (GLuint)ceil(segments));
+}
+
+
+void LODSelector::setPixelError(GLfloat pixelError)
+{
+	this->pixelError = std::max(pixelError, LOD_MIN_PIXEL_ERROR);
+}
@@ -0,0 +1,60 @@
+/* lodselect.h
+ Chooses levels of detail for the curved primitives from their size on screen. A mesh's bounding
+ sphere is projected to a radius in pixels. A circle of radius r pixels drawn with n straight
+ segments strays at most r * (1 - cos(pi / n)) pixels from the true outline, so the selector asks
+ for the fewest segments that keep this within the pixel error threshold. Sphere and Cylinder then
+ pick their coarsest level of detail with at least that many segments around the outline.
+*/
+
+#pragma once
+
+#include "meshbuffer.h"
+#include <glm/glm.hpp>
+
+const GLuint LOD_MAX_LEVELS = 6;
+
+/* Instances drawn and triangles submitted at each level of detail, since the last reset */
+struct LODStats
+{
+	GLuint draws[LOD_MAX_LEVELS];
+	GLuint triangles[LOD_MAX_LEVELS];
+
+	void reset()
+	{
+		for (GLuint i = 0; i < LOD_MAX_LEVELS; i++)
+		{
+			draws[i] = triangles[i] = 0;
+		}
+	}
+
+	void add(GLuint lod, GLuint instances, GLuint trianglesPerInstance)
+	{
+		draws[lod] += instances;
+		triangles[lod] += instances * trianglesPerInstance;
+	}
+};
+
+class LODSelector
+{
+public:
+	LODSelector(GLfloat pixelError = 0.5f);
+
+	/* Set the camera for this frame. viewportHeight is in pixels */
+	void setView(const glm::mat4 &view, const glm::mat4 &projection, GLfloat viewportHeight);
+
+	/* Radius in pixels of a mesh's bounding sphere placed by the model matrix. Very large when the camera
+	   is inside the sphere */
+	GLfloat getPixelRadius(const MeshBounds &bounds, const glm::mat4 &model) const;
+
+	/* Segments needed around an outline of this many pixels radius */
+	GLuint getSegments(GLfloat pixelRadius) const;
+	GLuint getSegments(const MeshBounds &bounds, const glm::mat4 &model) const { return getSegments(getPixelRadius(bounds, model)); }
+
+	void setPixelError(GLfloat pixelError);
+	GLfloat getPixelError() const { return pixelError; }
+
+private:
+	glm::mat4 view;
+	GLfloat pixelsPerUnit;		// Pixels covered by one unit at distance one in front of the camera
+	GLfloat pixelError;
+};
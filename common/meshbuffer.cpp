@@ -0,0 +1,303 @@
+/* meshbuffer.cpp
+ Shared vertex and index buffers for all the mesh objects, see meshbuffer.h
+*/
+
+#include "meshbuffer.h"
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+/* Initial sizes of the shared buffers, enough for the cigar box scene without growing */
+const GLuint MESH_INITIAL_VERTICES = 64 * 1024;
+const GLuint MESH_INITIAL_INDICES = 256 * 1024;
+
+MeshBuffer::MeshBuffer()
+	: vertexArena(sizeof(PackedVertex), MESH_INITIAL_VERTICES), indexArena(sizeof(GLuint), MESH_INITIAL_INDICES)
+{
+	vertexBuffer = indexBuffer = 0;
+	instanceBuffer = indirectBuffer = 0;
+	vao = instancedVao = 0;
+	batchCommands = batchInstances = 0;
+	multiDraw = false;
+	drawCalls = bytesUploaded = 0;
+}
+
+
+/* Create the vertex array objects and streaming buffers the first time a mesh is added, when there is a
+   current context. The arenas create their own buffers */
+void MeshBuffer::create()
+{
+	glGenBuffers(1, &instanceBuffer);
+	glGenBuffers(1, &indirectBuffer);
+	glGenVertexArrays(1, &vao);
+	glGenVertexArrays(1, &instancedVao);
+
+	multiDraw = glext_ARB_multi_draw_indirect != 0;
+}
+
+
+/* The arenas replace their buffers when they grow or are defragmented, so the vertex array objects are
+   pointed at the new ones whenever the names change */
+void MeshBuffer::updateBuffers()
+{
+	if (vertexArena.getBuffer() != vertexBuffer || indexArena.getBuffer() != indexBuffer)
+	{
+		vertexBuffer = vertexArena.getBuffer();
+		indexBuffer = indexArena.getBuffer();
+		defineVertexArrays();
+	}
+}
+
+
+/* Point both vertex array objects at the current buffers */
+void MeshBuffer::defineVertexArrays()
+{
+	GLStateCache &gl = GLWrapper::state();
+
+	gl.bindVertexArray(vao);
+	gl.bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	setPackedVertexAttribs(0, 1, 2);
+	gl.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+	gl.bindVertexArray(instancedVao);
+	gl.bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	setPackedVertexAttribs(0, 1, 2);
+	gl.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+	/* A mat4 attribute takes four consecutive locations, one per column, and a mat3 three. They and the
+	   tint advance once per instance, starting from the draw's baseInstance */
+	gl.bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	for (GLuint i = 0; i < 4; i++)
+	{
+		glEnableVertexAttribArray(MESH_ATTRIBUTE_INSTANCE_MODEL + i);
+		glVertexAttribPointer(MESH_ATTRIBUTE_INSTANCE_MODEL + i, 4, GL_FLOAT, GL_FALSE, sizeof(MeshInstance),
+			(void*)(offsetof(MeshInstance, model) + sizeof(vec4) * i));
+		glVertexAttribDivisor(MESH_ATTRIBUTE_INSTANCE_MODEL + i, 1);
+	}
+	glEnableVertexAttribArray(MESH_ATTRIBUTE_TINT);
+	glVertexAttribPointer(MESH_ATTRIBUTE_TINT, 4, GL_FLOAT, GL_FALSE, sizeof(MeshInstance), (void*)offsetof(MeshInstance, tint));
+	glVertexAttribDivisor(MESH_ATTRIBUTE_TINT, 1);
+	for (GLuint i = 0; i < 3; i++)
+	{
+		glEnableVertexAttribArray(MESH_ATTRIBUTE_INSTANCE_NORMAL + i);
+		glVertexAttribPointer(MESH_ATTRIBUTE_INSTANCE_NORMAL + i, 3, GL_FLOAT, GL_FALSE, sizeof(MeshInstance),
+			(void*)(offsetof(MeshInstance, normal) + sizeof(vec3) * i));
+		glVertexAttribDivisor(MESH_ATTRIBUTE_INSTANCE_NORMAL + i, 1);
+	}
+
+	gl.bindVertexArray(0);
+	gl.bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+/* Box from the minimum and maximum positions, then the sphere around its centre through the furthest vertex.
+   This isn't the smallest enclosing sphere but is close for the convex shapes used here */
+static MeshBounds calculateBounds(const PackedVertex *vertices, GLuint numvertices)
+{
+	MeshBounds bounds;
+	bounds.centre = bounds.extents = vec3(0.f);
+	bounds.radius = 0.f;
+	if (numvertices == 0) return bounds;
+
+	vec3 lowest(vertices[0].position[0], vertices[0].position[1], vertices[0].position[2]);
+	vec3 highest = lowest;
+	for (GLuint i = 1; i < numvertices; i++)
+	{
+		vec3 position(vertices[i].position[0], vertices[i].position[1], vertices[i].position[2]);
+		lowest = min(lowest, position);
+		highest = max(highest, position);
+	}
+	bounds.centre = (lowest + highest) * 0.5f;
+	bounds.extents = (highest - lowest) * 0.5f;
+
+	float furthest = 0.f;
+	for (GLuint i = 0; i < numvertices; i++)
+	{
+		vec3 position(vertices[i].position[0], vertices[i].position[1], vertices[i].position[2]);
+		furthest = std::max(furthest, dot(position - bounds.centre, position - bounds.centre));
+	}
+	bounds.radius = sqrt(furthest);
+	return bounds;
+}
+
+
+MeshHandle MeshBuffer::add(const PackedVertex *vertices, GLuint numvertices, const GLuint *indices, GLuint numindices)
+{
+	if (vao == 0) create();
+
+	Mesh mesh;
+	mesh.vertices = vertexArena.allocate(numvertices);
+	mesh.indices = indexArena.allocate(numindices);
+	vertexArena.upload(mesh.vertices, vertices, numvertices);
+	indexArena.upload(mesh.indices, indices, numindices);
+	bytesUploaded += sizeof(PackedVertex) * numvertices + sizeof(GLuint) * numindices;
+
+	mesh.range.baseVertex = vertexArena.getOffset(mesh.vertices);
+	mesh.range.vertexCount = numvertices;
+	mesh.range.firstIndex = indexArena.getOffset(mesh.indices);
+	mesh.range.indexCount = numindices;
+	mesh.bounds = calculateBounds(vertices, numvertices);
+	updateBuffers();
+
+	if (!unusedMeshes.empty())
+	{
+		MeshHandle handle = unusedMeshes.back();
+		unusedMeshes.pop_back();
+		meshes[handle] = mesh;
+		return handle;
+	}
+	meshes.push_back(mesh);
+	return (MeshHandle)meshes.size() - 1;
+}
+
+
+void MeshBuffer::remove(MeshHandle mesh)
+{
+	vertexArena.free(meshes[mesh].vertices);
+	indexArena.free(meshes[mesh].indices);
+	meshes[mesh].vertices = meshes[mesh].indices = ARENA_NO_HANDLE;
+	unusedMeshes.push_back(mesh);
+}
+
+
+void MeshBuffer::defragment()
+{
+	bool verticesMoved = vertexArena.defragment();
+	bool indicesMoved = indexArena.defragment();
+	if (!verticesMoved && !indicesMoved) return;
+
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		if (meshes[i].vertices == ARENA_NO_HANDLE) continue;
+		meshes[i].range.baseVertex = vertexArena.getOffset(meshes[i].vertices);
+		meshes[i].range.firstIndex = indexArena.getOffset(meshes[i].indices);
+	}
+	updateBuffers();
+}
+
+
+void MeshBuffer::drawRange(const MeshRange &mesh, GLenum mode, const vec4 &tint)
+{
+	GLWrapper::state().bindVertexArray(vao);
+
+	/* The tint array is disabled in this vertex array object so it is read from the attribute's constant value */
+	glVertexAttrib4f(MESH_ATTRIBUTE_TINT, tint.r, tint.g, tint.b, tint.a);
+	drawCalls++;
+
+	if (mode == GL_POINTS)
+	{
+		glDrawArrays(GL_POINTS, mesh.baseVertex, mesh.vertexCount);
+	}
+	else
+	{
+		glDrawElementsBaseVertex(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT,
+			(GLvoid*)(sizeof(GLuint) * mesh.firstIndex), mesh.baseVertex);
+	}
+}
+
+
+/* Respecifying the whole buffer lets the driver orphan the previous contents rather than waiting for
+   earlier draws that still read from it */
+void MeshBuffer::uploadInstances(const MeshInstance *instances, GLuint count)
+{
+	GLWrapper::state().bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(MeshInstance) * count, instances, GL_STREAM_DRAW);
+	GLWrapper::state().bindBuffer(GL_ARRAY_BUFFER, 0);
+	bytesUploaded += sizeof(MeshInstance) * count;
+}
+
+
+void MeshBuffer::drawInstanced(MeshHandle handle, GLenum mode, const MeshInstance *instances, GLuint count)
+{
+	if (count == 0) return;
+
+	const MeshRange &mesh = meshes[handle].range;
+	uploadInstances(instances, count);
+	GLWrapper::state().bindVertexArray(instancedVao);
+	drawCalls++;
+
+	if (mode == GL_POINTS)
+	{
+		glDrawArraysInstanced(GL_POINTS, mesh.baseVertex, mesh.vertexCount, count);
+	}
+	else
+	{
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT,
+			(GLvoid*)(sizeof(GLuint) * mesh.firstIndex), count, mesh.baseVertex);
+	}
+}
+
+
+void MeshBuffer::addToBatch(MeshHandle mesh, const mat4 &model, const mat3 &normal, const vec4 &tint)
+{
+	MeshInstance instance;
+	instance.model = model;
+	instance.tint = tint;
+	instance.normal = normal;
+	addToBatch(mesh, &instance, 1);
+}
+
+
+void MeshBuffer::addToBatch(MeshHandle handle, const MeshInstance *instances, GLuint count)
+{
+	if (count == 0) return;
+
+	const MeshRange &mesh = meshes[handle].range;
+
+	/* Extend the last command if it draws the same mesh, its instances are the last ones added */
+	if (!commands.empty())
+	{
+		DrawElementsIndirectCommand &last = commands.back();
+		if (last.firstIndex == mesh.firstIndex && last.count == mesh.indexCount && last.baseVertex == (GLint)mesh.baseVertex)
+		{
+			last.instanceCount += count;
+			this->instances.insert(this->instances.end(), instances, instances + count);
+			return;
+		}
+	}
+
+	DrawElementsIndirectCommand command;
+	command.count = mesh.indexCount;
+	command.instanceCount = count;
+	command.firstIndex = mesh.firstIndex;
+	command.baseVertex = mesh.baseVertex;
+	command.baseInstance = (GLuint)this->instances.size();
+	commands.push_back(command);
+	this->instances.insert(this->instances.end(), instances, instances + count);
+}
+
+
+/* Submit everything added since the last batch and start a new one */
+void MeshBuffer::drawBatch()
+{
+	batchCommands = (GLuint)commands.size();
+	batchInstances = (GLuint)instances.size();
+	if (commands.empty()) return;
+
+	uploadInstances(&instances[0], batchInstances);
+
+	GLWrapper::state().bindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * batchCommands, &commands[0], GL_STREAM_DRAW);
+	bytesUploaded += sizeof(DrawElementsIndirectCommand) * batchCommands;
+
+	GLWrapper::state().bindVertexArray(instancedVao);
+	if (multiDraw)
+	{
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, batchCommands, 0);
+		drawCalls++;
+	}
+	else
+	{
+		for (GLuint i = 0; i < batchCommands; i++)
+		{
+			glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (GLvoid*)(sizeof(DrawElementsIndirectCommand) * i));
+		}
+		drawCalls += batchCommands;
+	}
+
+	commands.clear();
+	instances.clear();
+}
@@ -0,0 +1,144 @@
+/* meshbuffer.h
+ One vertex buffer and one index buffer shared by every Cube, Sphere and Cylinder. Each mesh is
+ sub-allocated a range of both, so all the objects are drawn from the same vertex array object and
+ there is nothing to rebind between draws.
+
+ Draws can be collected into a batch with addToBatch() and submitted together by drawBatch(). The
+ batch is a DrawElementsIndirectCommand per mesh and a MeshInstance (model matrix, tint and normal
+ matrix) per copy, read by the vertex shader as per-instance attributes. Each command's baseInstance points at
+ its first MeshInstance. The whole batch is one glMultiDrawElementsIndirect when
+ GL_ARB_multi_draw_indirect is available, and a glDrawElementsIndirect per command otherwise, so
+ the CPU cost of submitting it is the same whatever is in it. A non-zero baseInstance in an
+ indirect command needs OpenGL 4.2 (or GL_ARB_base_instance), which the wrapper's context provides.
+
+ The vertices and indices are sub-allocated from two BufferArenas (see bufferarena.h), so meshes can
+ be added and removed freely without creating or deleting driver buffers. add() returns a handle,
+ which stays valid when the arenas grow or are defragmented and the mesh's range moves.
+*/
+
+#pragma once
+
+#include "wrapper_glfw.h"
+#include "vertexformat.h"
+#include "bufferarena.h"
+#include <vector>
+#include <glm/glm.hpp>
+
+/* Attribute locations of the per-instance model matrix (four consecutive locations, one per column),
+   tint and normal matrix (three locations). The tint multiplies the vertex colour, single draws set it as
+   a constant attribute value */
+const GLuint MESH_ATTRIBUTE_INSTANCE_MODEL = 3;
+const GLuint MESH_ATTRIBUTE_TINT = 7;
+const GLuint MESH_ATTRIBUTE_INSTANCE_NORMAL = 8;
+
+/* Where a mesh's vertices and indices are in the shared buffers. The indices are relative to
+   baseVertex */
+struct MeshRange
+{
+	GLuint firstIndex;
+	GLuint indexCount;
+	GLuint baseVertex;
+	GLuint vertexCount;
+};
+
+/* Bounds of a mesh's vertex positions: the axis aligned box as its centre and half extents, and the
+   sphere around the same centre that encloses every vertex */
+struct MeshBounds
+{
+	glm::vec3 centre;
+	glm::vec3 extents;
+	GLfloat radius;
+};
+
+typedef GLuint MeshHandle;
+
+/* Layout fixed by OpenGL for glDrawElementsIndirect */
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+/* The normal matrix is the eye space one, transpose(inverse(mat3(view * model))), so the vertex shader
+   doesn't have to invert anything */
+struct MeshInstance
+{
+	glm::mat4 model;
+	glm::vec4 tint;
+	glm::mat3 normal;
+};
+
+class MeshBuffer
+{
+public:
+	MeshBuffer();
+
+	/* Copy a mesh into the shared buffers. The indices are relative to the first of its vertices */
+	MeshHandle add(const PackedVertex *vertices, GLuint numvertices, const GLuint *indices, GLuint numindices);
+
+	/* Give a mesh's space back. The handle may be reused by a later add() */
+	void remove(MeshHandle mesh);
+
+	/* Pack the meshes together so the free space in each buffer is one block. Don't call this between
+	   adding to a batch and drawing it */
+	void defragment();
+
+	const MeshRange &getRange(MeshHandle mesh) const { return meshes[mesh].range; }
+	const MeshBounds &getBounds(MeshHandle mesh) const { return meshes[mesh].bounds; }
+
+	/* Single draws of a mesh, or any range of the shared buffers. mode is GL_TRIANGLES to draw the indexed
+	   triangles or GL_POINTS to draw each vertex once */
+	void draw(MeshHandle mesh, GLenum mode, const glm::vec4 &tint = glm::vec4(1.f)) { drawRange(meshes[mesh].range, mode, tint); }
+	void drawRange(const MeshRange &range, GLenum mode, const glm::vec4 &tint = glm::vec4(1.f));
+	void drawInstanced(MeshHandle mesh, GLenum mode, const MeshInstance *instances, GLuint count);
+
+	/* Collect draws for this frame's batch and submit them. Consecutive additions of the same mesh share
+	   a command. The vertex shader must have its instanced flag set while drawBatch is called */
+	void addToBatch(MeshHandle mesh, const glm::mat4 &model, const glm::mat3 &normal, const glm::vec4 &tint = glm::vec4(1.f));
+	void addToBatch(MeshHandle mesh, const MeshInstance *instances, GLuint count);
+	void drawBatch();
+
+	/* Commands and instances in the last batch drawn, and whether it was one multi-draw */
+	GLuint getBatchCommands() const { return batchCommands; }
+	GLuint getBatchInstances() const { return batchInstances; }
+	bool isMultiDraw() const { return multiDraw; }
+
+	/* Draw calls issued and bytes of vertices, indices, instances and indirect commands uploaded since the start */
+	unsigned long long getDrawCalls() const { return drawCalls; }
+	unsigned long long getBytesUploaded() const { return bytesUploaded; }
+
+	BufferArenaStats getVertexStats() const { return vertexArena.getStats(); }
+	BufferArenaStats getIndexStats() const { return indexArena.getStats(); }
+
+private:
+	struct Mesh
+	{
+		ArenaHandle vertices, indices;
+		MeshRange range;
+		MeshBounds bounds;
+	};
+
+	void create();
+	void updateBuffers();
+	void defineVertexArrays();
+	void uploadInstances(const MeshInstance *instances, GLuint count);
+
+	BufferArena vertexArena, indexArena;
+	std::vector<Mesh> meshes;
+	std::vector<MeshHandle> unusedMeshes;
+
+	GLuint vertexBuffer, indexBuffer;	// The arenas' buffers when the vertex array objects were last defined
+	GLuint instanceBuffer, indirectBuffer;
+	GLuint vao;				// Vertex data only, for single draws
+	GLuint instancedVao;	// Vertex data and the per-instance model matrix, tint and normal matrix
+
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<MeshInstance> instances;
+	GLuint batchCommands, batchInstances;
+	bool multiDraw;
+
+	unsigned long long drawCalls, bytesUploaded;
+};
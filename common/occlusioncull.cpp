@@ -0,0 +1,259 @@
+/* occlusioncull.cpp
+ Occluder rasterisation, hierarchical-Z building and box tests, see occlusioncull.h
+*/
+
+#include "occlusioncull.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define OCCLUSIONCULL_X86 1
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+using namespace glm;
+
+/* The 12 triangles of a box whose corners are numbered by the bits of their index: bit 0 set for +x,
+   bit 1 for +y and bit 2 for +z. Both windings are rasterised so the order doesn't matter */
+static const unsigned int boxIndices[36] =
+{
+	0, 1, 3, 0, 3, 2,	// -z
+	4, 6, 7, 4, 7, 5,	// +z
+	0, 2, 6, 0, 6, 4,	// -x
+	1, 5, 7, 1, 7, 3,	// +x
+	0, 4, 5, 0, 5, 1,	// -y
+	2, 3, 7, 2, 7, 6	// +y
+};
+
+static vec3 boxCorner(const vec3 &centre, const vec3 &extents, int i)
+{
+	return centre + extents * vec3((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f, (i & 4) ? 1.f : -1.f);
+}
+
+
+OcclusionCuller::OcclusionCuller(int width, int height)
+{
+	this->width = (width + 3) & ~3;
+	this->height = height;
+	isa = TRANSFORM_SCALAR;
+	stats.occluderTriangles = stats.tested = stats.occluded = 0;
+
+	/* Halve each level, rounding up, until both sides are 1. Texel x of a level then covers pixels x << level
+	   up to ((x + 1) << level) - 1 whatever the size, and x >> level of any pixel is inside the level */
+	int w = this->width, h = height;
+	while (true)
+	{
+		levels.push_back(vector<float>(w * h, 1.f));
+		levelWidths.push_back(w);
+		levelHeights.push_back(h);
+		if (w == 1 && h == 1) break;
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+	}
+}
+
+
+void OcclusionCuller::begin(const mat4 &viewProjection, TransformISA isa)
+{
+	this->viewProjection = viewProjection;
+	this->isa = isa;
+	std::fill(levels[0].begin(), levels[0].end(), 1.f);
+	stats.occluderTriangles = stats.tested = stats.occluded = 0;
+}
+
+
+/* Window coordinates of a clip space position, or false if it is behind the near plane */
+bool OcclusionCuller::toScreen(const vec4 &clip, ScreenVertex &v) const
+{
+	if (clip.w <= 1e-6f || clip.z < -clip.w) return false;
+
+	float w = 1.f / clip.w;
+	v.x = (clip.x * w * 0.5f + 0.5f) * width;
+	v.y = (clip.y * w * 0.5f + 0.5f) * height;
+	v.z = clip.z * w * 0.5f + 0.5f;
+	return true;
+}
+
+
+void OcclusionCuller::addOccluder(const vec3 *positions, const unsigned int *indices, int numindices, const mat4 &model)
+{
+	mat4 modelViewProjection = viewProjection * model;
+
+	for (int i = 0; i + 2 < numindices; i += 3)
+	{
+		ScreenVertex v[3];
+		bool inFront = true;
+		for (int j = 0; j < 3 && inFront; j++)
+		{
+			inFront = toScreen(modelViewProjection * vec4(positions[indices[i + j]], 1.f), v[j]);
+		}
+		if (!inFront) continue;
+
+		rasterise(v[0], v[1], v[2]);
+		stats.occluderTriangles++;
+	}
+}
+
+
+void OcclusionCuller::addOccluderBox(const vec3 &centre, const vec3 &extents, const mat4 &model)
+{
+	vec3 corners[8];
+	for (int i = 0; i < 8; i++)
+	{
+		corners[i] = boxCorner(centre, extents, i);
+	}
+	addOccluder(corners, boxIndices, 36, model);
+}
+
+
+/* Each edge function is positive on the inside of its edge, once the triangle is wound anticlockwise.
+   Divided by the area they are the barycentric weights of the opposite corners, so depth is also a
+   plane a * x + b * y + c across the screen */
+void OcclusionCuller::rasterise(const ScreenVertex &v0, const ScreenVertex &in1, const ScreenVertex &in2)
+{
+	float area = (in1.x - v0.x) * (in2.y - v0.y) - (in2.x - v0.x) * (in1.y - v0.y);
+	if (fabs(area) < 1e-8f) return;
+
+	const ScreenVertex &v1 = area > 0.f ? in1 : in2;
+	const ScreenVertex &v2 = area > 0.f ? in2 : in1;
+	area = fabs(area);
+
+	const ScreenVertex *from[3] = { &v1, &v2, &v0 };
+	const ScreenVertex *to[3] = { &v2, &v0, &v1 };
+	float edgeA[3], edgeB[3], edgeC[3];
+	for (int e = 0; e < 3; e++)
+	{
+		edgeA[e] = from[e]->y - to[e]->y;
+		edgeB[e] = to[e]->x - from[e]->x;
+		edgeC[e] = from[e]->x * to[e]->y - from[e]->y * to[e]->x;
+	}
+	float depthA = (edgeA[0] * v0.z + edgeA[1] * v1.z + edgeA[2] * v2.z) / area;
+	float depthB = (edgeB[0] * v0.z + edgeB[1] * v1.z + edgeB[2] * v2.z) / area;
+	float depthC = (edgeC[0] * v0.z + edgeC[1] * v1.z + edgeC[2] * v2.z) / area;
+
+	int minX = std::max(0, (int)floor(std::min(v0.x, std::min(v1.x, v2.x))));
+	int maxX = std::min(width - 1, (int)floor(std::max(v0.x, std::max(v1.x, v2.x))));
+	int minY = std::max(0, (int)floor(std::min(v0.y, std::min(v1.y, v2.y))));
+	int maxY = std::min(height - 1, (int)floor(std::max(v0.y, std::max(v1.y, v2.y))));
+	if (minX > maxX || minY > maxY) return;
+
+	float *depth = &levels[0][0];
+
+#ifdef OCCLUSIONCULL_X86
+	if (isa != TRANSFORM_SCALAR)
+	{
+		/* 4 pixels per step from a multiple of 4, so a block never crosses the end of a row. Pixels in the
+		   block outside the bounding box are outside the triangle as well */
+		const __m128 centres = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		const __m128 zero = _mm_setzero_ps();
+		__m128 a0 = _mm_set1_ps(edgeA[0]), a1 = _mm_set1_ps(edgeA[1]), a2 = _mm_set1_ps(edgeA[2]);
+		__m128 za = _mm_set1_ps(depthA);
+
+		for (int y = minY; y <= maxY; y++)
+		{
+			float py = y + 0.5f;
+			__m128 r0 = _mm_set1_ps(edgeB[0] * py + edgeC[0]);
+			__m128 r1 = _mm_set1_ps(edgeB[1] * py + edgeC[1]);
+			__m128 r2 = _mm_set1_ps(edgeB[2] * py + edgeC[2]);
+			__m128 rz = _mm_set1_ps(depthB * py + depthC);
+			float *row = depth + y * width;
+
+			for (int x = minX & ~3; x <= maxX; x += 4)
+			{
+				__m128 px = _mm_add_ps(_mm_set1_ps((float)x), centres);
+				__m128 inside = _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), r0), zero),
+					_mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), r1), zero),
+						_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), r2), zero)));
+				if (_mm_movemask_ps(inside) == 0) continue;
+
+				__m128 old = _mm_loadu_ps(row + x);
+				__m128 nearest = _mm_min_ps(old, _mm_add_ps(_mm_mul_ps(za, px), rz));
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+			}
+		}
+		return;
+	}
+#endif
+
+	for (int y = minY; y <= maxY; y++)
+	{
+		float py = y + 0.5f;
+		float *row = depth + y * width;
+		for (int x = minX; x <= maxX; x++)
+		{
+			float px = x + 0.5f;
+			if (edgeA[0] * px + edgeB[0] * py + edgeC[0] < 0.f) continue;
+			if (edgeA[1] * px + edgeB[1] * py + edgeC[1] < 0.f) continue;
+			if (edgeA[2] * px + edgeB[2] * py + edgeC[2] < 0.f) continue;
+			row[x] = std::min(row[x], depthA * px + depthB * py + depthC);
+		}
+	}
+}
+
+
+/* Each texel of a level is the farthest of the 2x2 below it. Where a side below is odd, or down to 1,
+   the last texel along it has no pair and is used twice */
+void OcclusionCuller::buildHiZ()
+{
+	for (size_t level = 1; level < levels.size(); level++)
+	{
+		const vector<float> &below = levels[level - 1];
+		int belowWidth = levelWidths[level - 1], belowHeight = levelHeights[level - 1];
+		vector<float> &above = levels[level];
+		int w = levelWidths[level], h = levelHeights[level];
+
+		for (int y = 0; y < h; y++)
+		{
+			int y0 = std::min(y * 2, belowHeight - 1), y1 = std::min(y * 2 + 1, belowHeight - 1);
+			for (int x = 0; x < w; x++)
+			{
+				int x0 = std::min(x * 2, belowWidth - 1), x1 = std::min(x * 2 + 1, belowWidth - 1);
+				above[y * w + x] = std::max(std::max(below[y0 * belowWidth + x0], below[y0 * belowWidth + x1]),
+					std::max(below[y1 * belowWidth + x0], below[y1 * belowWidth + x1]));
+			}
+		}
+	}
+}
+
+
+/* The box's screen rectangle and nearest depth come from its eight projected corners. It is hidden when
+   that depth is behind the farthest occluder depth in every texel the rectangle touches */
+bool OcclusionCuller::isBoxVisible(const vec3 &centre, const vec3 &extents, const mat4 &model)
+{
+	stats.tested++;
+	mat4 modelViewProjection = viewProjection * model;
+
+	float minX = (float)width, maxX = 0.f, minY = (float)height, maxY = 0.f, nearest = 1.f;
+	for (int i = 0; i < 8; i++)
+	{
+		ScreenVertex v;
+		if (!toScreen(modelViewProjection * vec4(boxCorner(centre, extents, i), 1.f), v)) return true;
+		minX = std::min(minX, v.x); maxX = std::max(maxX, v.x);
+		minY = std::min(minY, v.y); maxY = std::max(maxY, v.y);
+		nearest = std::min(nearest, v.z);
+	}
+
+	int x0 = std::max(0, (int)floor(minX)), x1 = std::min(width - 1, (int)floor(maxX));
+	int y0 = std::max(0, (int)floor(minY)), y1 = std::min(height - 1, (int)floor(maxY));
+	if (x0 > x1 || y0 > y1) return true;
+
+	size_t level = 0;
+	while (level + 1 < levels.size() && ((x1 >> level) - (x0 >> level) >= 4 || (y1 >> level) - (y0 >> level) >= 4))
+	{
+		level++;
+	}
+
+	const vector<float> &hiz = levels[level];
+	int w = levelWidths[level];
+	for (int y = y0 >> level; y <= (y1 >> level); y++)
+	{
+		for (int x = x0 >> level; x <= (x1 >> level); x++)
+		{
+			if (nearest <= hiz[y * w + x]) return true;
+		}
+	}
+
+	stats.occluded++;
+	return false;
+}
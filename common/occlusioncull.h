@@ -0,0 +1,74 @@
+/* occlusioncull.h
+ Software occlusion culling on the CPU. Large occluders are rasterised into a small depth buffer,
+ then the bounding boxes of other objects are tested against it, so objects hidden behind them
+ can be skipped before they are submitted. It only uses glm, no OpenGL, so it can be run and
+ tested without a GPU, as the OcclusionTest project does.
+
+ The depth buffer holds the nearest occluder depth at each pixel centre, as window depth in
+ [0, 1]. Rows are rasterised 4 pixels at a time with SSE where available. After the occluders are
+ added buildHiZ() makes a hierarchical-Z chain where each level holds the farthest depth of the
+ 2x2 pixels below it, so a box is tested against only a few texels of the level where its screen
+ rectangle is at most 4 texels across.
+
+ Occluder triangles crossing the near plane are skipped, and boxes crossing it are always
+ visible, so both err towards drawing. Occluders are sampled at pixel centres, so an object that
+ pokes out from behind one by less than a pixel of this low resolution buffer can be dropped.
+*/
+
+#pragma once
+
+#include "cpufeatures.h"
+#include <vector>
+#include <glm/glm.hpp>
+
+const int OCCLUSION_WIDTH = 256;
+const int OCCLUSION_HEIGHT = 128;
+
+struct OcclusionStats
+{
+	unsigned int occluderTriangles;	// Triangles rasterised, after those crossing the near plane are skipped
+	unsigned int tested;
+	unsigned int occluded;
+};
+
+class OcclusionCuller
+{
+public:
+	/* Any size works. The width is rounded up to a multiple of 4 for the rows rasterised 4 pixels at a time */
+	OcclusionCuller(int width = OCCLUSION_WIDTH, int height = OCCLUSION_HEIGHT);
+
+	/* Clear the depth buffer and counts for a new frame seen through viewProjection */
+	void begin(const glm::mat4 &viewProjection, TransformISA isa = getBestTransformISA());
+
+	/* Rasterise an occluder. Boxes are given as centre and half extents in model space, the same as MeshBounds */
+	void addOccluder(const glm::vec3 *positions, const unsigned int *indices, int numindices, const glm::mat4 &model);
+	void addOccluderBox(const glm::vec3 &centre, const glm::vec3 &extents, const glm::mat4 &model);
+
+	/* Build the hierarchical-Z levels. Call after the last occluder and before testing */
+	void buildHiZ();
+
+	/* False only if the box is entirely behind the occluders */
+	bool isBoxVisible(const glm::vec3 &centre, const glm::vec3 &extents, const glm::mat4 &model);
+
+	OcclusionStats getStats() const { return stats; }
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	const float *getDepth(int level = 0) const { return &levels[level][0]; }
+
+private:
+	struct ScreenVertex
+	{
+		float x, y, z;
+	};
+
+	void rasterise(const ScreenVertex &v0, const ScreenVertex &v1, const ScreenVertex &v2);
+	bool toScreen(const glm::vec4 &clip, ScreenVertex &v) const;
+
+	int width, height;
+	glm::mat4 viewProjection;
+	TransformISA isa;
+	std::vector<std::vector<float> > levels;	// levels[0] is the full resolution depth buffer
+	std::vector<int> levelWidths, levelHeights;
+	OcclusionStats stats;
+};
@@ -0,0 +1,233 @@
+/* profiler.cpp
+ CPU and GPU timing sections, see profiler.h
+*/
+
+#include "profiler.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+using namespace std;
+
+void ProfileHistory::copy(vector<float> &out) const
+{
+	unsigned int n = written.load(memory_order_acquire);
+	unsigned int count = std::min(n, PROFILE_HISTORY);
+	out.resize(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		out[i] = samples[(n - count + i) % PROFILE_HISTORY];
+	}
+}
+
+
+Profiler::Profiler() : numSections(0)
+{
+	currentFrame = 0;
+	droppedQueries = 0;
+	for (int i = 0; i < PROFILER_GPU_FRAMES; i++)
+	{
+		gpuFrames[i].used = 0;
+	}
+}
+
+
+void Profiler::beginFrame()
+{
+	currentFrame = (currentFrame + 1) % PROFILER_GPU_FRAMES;
+	collect(gpuFrames[currentFrame]);
+	openRanges.clear();
+}
+
+
+/* Read back a frame's timestamps if they are ready and free its queries for reuse */
+void Profiler::collect(GPUFrame &frame)
+{
+	for (size_t i = 0; i < frame.ranges.size(); i++)
+	{
+		const GPURange &range = frame.ranges[i];
+		if (range.end == 0) continue;		// Never ended
+
+		GLint available = 0;
+		glGetQueryObjectiv(range.end, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			droppedQueries++;
+			continue;
+		}
+
+		GLuint64 begin, end;
+		glGetQueryObjectui64v(range.begin, GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(range.end, GL_QUERY_RESULT, &end);
+		sections[range.section].history.add((float)((end - begin) / 1.0e6));
+	}
+	frame.ranges.clear();
+	frame.used = 0;
+}
+
+
+GLuint Profiler::nextQuery()
+{
+	GPUFrame &frame = gpuFrames[currentFrame];
+	if (frame.used == frame.queries.size())
+	{
+		GLuint query;
+		glGenQueries(1, &query);
+		frame.queries.push_back(query);
+	}
+	return frame.queries[frame.used++];
+}
+
+
+/* Sections are only added by the writing thread. The count is published after the section is filled in so
+   readers never see a half made one */
+int Profiler::getSection(const char *name, ProfileType type)
+{
+	int count = numSections.load(memory_order_relaxed);
+	for (int i = 0; i < count; i++)
+	{
+		if (sections[i].type == type && sections[i].name == name) return i;
+	}
+	if (count == PROFILE_MAX_SECTIONS) return -1;
+
+	sections[count].name = name;
+	sections[count].type = type;
+	numSections.store(count + 1, memory_order_release);
+	return count;
+}
+
+
+void Profiler::beginCPU(int section)
+{
+	if (section < 0) return;
+	sections[section].cpuStart = Clock::now();
+}
+
+
+void Profiler::endCPU(int section)
+{
+	if (section < 0) return;
+	sections[section].history.add(chrono::duration<float, milli>(Clock::now() - sections[section].cpuStart).count());
+}
+
+
+void Profiler::beginGPU(int section)
+{
+	if (section < 0) return;
+
+	GPURange range;
+	range.section = section;
+	range.begin = nextQuery();
+	range.end = 0;
+	glQueryCounter(range.begin, GL_TIMESTAMP);
+
+	GPUFrame &frame = gpuFrames[currentFrame];
+	openRanges.push_back(frame.ranges.size());
+	frame.ranges.push_back(range);
+}
+
+
+/* Sections normally end in the reverse order they began, so the match is usually the last one opened */
+void Profiler::endGPU(int section)
+{
+	if (section < 0) return;
+
+	GPUFrame &frame = gpuFrames[currentFrame];
+	for (size_t i = openRanges.size(); i-- > 0; )
+	{
+		GPURange &range = frame.ranges[openRanges[i]];
+		if (range.section != section) continue;
+
+		range.end = nextQuery();
+		glQueryCounter(range.end, GL_TIMESTAMP);
+		openRanges.erase(openRanges.begin() + i);
+		return;
+	}
+}
+
+
+/* Nearest rank percentiles of the sorted samples */
+ProfileStats Profiler::getStats(int section) const
+{
+	ProfileStats stats;
+	vector<float> samples;
+	sections[section].history.copy(samples);
+
+	stats.samples = (unsigned int)samples.size();
+	stats.mean = stats.p50 = stats.p95 = stats.p99 = stats.maximum = 0;
+	if (samples.empty()) return stats;
+
+	sort(samples.begin(), samples.end());
+	double sum = 0;
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		sum += samples[i];
+	}
+	stats.mean = sum / samples.size();
+
+	size_t n = samples.size();
+	stats.p50 = samples[(n * 50 + 99) / 100 - 1];
+	stats.p95 = samples[(n * 95 + 99) / 100 - 1];
+	stats.p99 = samples[(n * 99 + 99) / 100 - 1];
+	stats.maximum = samples[n - 1];
+	return stats;
+}
+
+
+static const char *typeName(ProfileType type)
+{
+	return type == PROFILE_GPU ? "GPU" : "CPU";
+}
+
+
+void Profiler::report(ostream &out) const
+{
+	out << left << setw(12) << "section" << setw(5) << "type" << right << setw(9) << "samples" << setw(10) << "mean"
+		<< setw(10) << "p50" << setw(10) << "p95" << setw(10) << "p99" << setw(10) << "max" << endl;
+	out << fixed << setprecision(3);
+	for (int i = 0; i < getNumSections(); i++)
+	{
+		ProfileStats stats = getStats(i);
+		out << left << setw(12) << sections[i].name << setw(5) << typeName(sections[i].type) << right << setw(9) << stats.samples
+			<< setw(10) << stats.mean << setw(10) << stats.p50 << setw(10) << stats.p95 << setw(10) << stats.p99
+			<< setw(10) << stats.maximum << endl;
+	}
+	out.unsetf(ios::floatfield);
+	out << setprecision(6);
+	if (droppedQueries) out << droppedQueries << " GPU samples dropped because they weren't ready" << endl;
+}
+
+
+bool Profiler::exportCSV() const
+{
+	if (exportPath.empty()) return false;
+
+	ofstream file(exportPath.c_str());
+	if (!file.is_open()) return false;
+
+	file << "section,type,samples,mean_ms,p50_ms,p95_ms,p99_ms,max_ms" << endl;
+	for (int i = 0; i < getNumSections(); i++)
+	{
+		ProfileStats stats = getStats(i);
+		file << sections[i].name << "," << typeName(sections[i].type) << "," << stats.samples << "," << stats.mean << ","
+			<< stats.p50 << "," << stats.p95 << "," << stats.p99 << "," << stats.maximum << endl;
+	}
+	return true;
+}
+
+
+ProfileScope::ProfileScope(Profiler &profiler, const char *name, ProfileType type) : profiler(profiler)
+{
+	cpuSection = (type & PROFILE_CPU) ? profiler.getSection(name, PROFILE_CPU) : -1;
+	gpuSection = (type & PROFILE_GPU) ? profiler.getSection(name, PROFILE_GPU) : -1;
+	profiler.beginGPU(gpuSection);
+	profiler.beginCPU(cpuSection);
+}
+
+
+ProfileScope::~ProfileScope()
+{
+	profiler.endCPU(cpuSection);
+	profiler.endGPU(gpuSection);
+}
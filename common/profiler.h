@@ -0,0 +1,147 @@
+/* profiler.h
+ Named timing sections for the phases of a frame, measured on the CPU, the GPU or both.
+
+ CPU sections time the code between begin and end on the steady clock. GPU sections write a
+ GL_TIMESTAMP query at each end, with glQueryCounter. Timestamps rather than GL_TIME_ELAPSED
+ queries are used so that GPU sections can nest. The queries of each frame are kept in a ring of
+ PROFILER_GPU_FRAMES frames and only read back when their slot is about to be reused. By then the
+ GPU has normally finished with them. Any that still aren't available are dropped rather than
+ waited for, so profiling never stalls the pipeline.
+
+ Each section keeps its last PROFILE_HISTORY samples for the 50th, 95th and 99th percentiles. The
+ histories have one writer, the thread with the context. Other threads can read them at any time
+ without locking; a sample being overwritten as it is read may be the old or the new value.
+ The summary can be written as CSV when the event loop exits.
+*/
+
+#pragma once
+
+#include <glload/gl_4_0.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <ostream>
+
+const int PROFILE_MAX_SECTIONS = 32;
+const unsigned int PROFILE_HISTORY = 1024;
+const int PROFILER_GPU_FRAMES = 4;
+
+enum ProfileType
+{
+	PROFILE_CPU = 1,
+	PROFILE_GPU = 2,
+	PROFILE_CPU_GPU = PROFILE_CPU | PROFILE_GPU
+};
+
+/* Times in milliseconds over the samples in a section's history */
+struct ProfileStats
+{
+	unsigned int samples;
+	double mean;
+	double p50, p95, p99;
+	double maximum;
+};
+
+/* A fixed size ring of samples with a single writer */
+class ProfileHistory
+{
+public:
+	ProfileHistory() : written(0) {}
+
+	void add(float milliseconds)
+	{
+		unsigned int n = written.load(std::memory_order_relaxed);
+		samples[n % PROFILE_HISTORY] = milliseconds;
+		written.store(n + 1, std::memory_order_release);
+	}
+
+	/* Copy out the samples currently held, oldest first */
+	void copy(std::vector<float> &out) const;
+
+private:
+	std::atomic<unsigned int> written;
+	float samples[PROFILE_HISTORY];
+};
+
+class Profiler
+{
+public:
+	Profiler();
+
+	/* Start a frame's GPU queries, reading back the frame that last used this slot. The event loop calls this */
+	void beginFrame();
+
+	/* Find or add a section. CPU and GPU sections of the same name are separate */
+	int getSection(const char *name, ProfileType type);
+
+	void beginCPU(int section);
+	void endCPU(int section);
+	void beginGPU(int section);
+	void endGPU(int section);
+
+	int getNumSections() const { return numSections.load(std::memory_order_acquire); }
+	const std::string &getSectionName(int section) const { return sections[section].name; }
+	ProfileType getSectionType(int section) const { return sections[section].type; }
+	ProfileStats getStats(int section) const;
+
+	/* GPU sections whose results weren't ready when their slot was reused */
+	unsigned int getDroppedQueries() const { return droppedQueries; }
+
+	/* Print a table of every section's stats */
+	void report(std::ostream &out) const;
+
+	/* Write the table as CSV to the export path, if one has been set. The event loop calls this when it exits */
+	void setExportPath(const std::string &path) { exportPath = path; }
+	bool exportCSV() const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Section
+	{
+		std::string name;
+		ProfileType type;
+		Clock::time_point cpuStart;
+		ProfileHistory history;
+	};
+
+	/* A GPU section's two timestamp queries in one frame */
+	struct GPURange
+	{
+		int section;
+		GLuint begin, end;
+	};
+
+	struct GPUFrame
+	{
+		std::vector<GLuint> queries;		// Query objects owned by this slot, reused each time round
+		GLuint used;
+		std::vector<GPURange> ranges;
+	};
+
+	GLuint nextQuery();
+	void collect(GPUFrame &frame);
+
+	Section sections[PROFILE_MAX_SECTIONS];
+	std::atomic<int> numSections;
+
+	GPUFrame gpuFrames[PROFILER_GPU_FRAMES];
+	int currentFrame;
+	std::vector<size_t> openRanges;		// Indices into the current frame's ranges of GPU sections not yet ended
+	unsigned int droppedQueries;
+
+	std::string exportPath;
+};
+
+/* Times the rest of the enclosing block as a section */
+class ProfileScope
+{
+public:
+	ProfileScope(Profiler &profiler, const char *name, ProfileType type = PROFILE_CPU);
+	~ProfileScope();
+
+private:
+	Profiler &profiler;
+	int cpuSection, gpuSection;
+};
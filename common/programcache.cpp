@@ -0,0 +1,352 @@
+/* programcache.cpp
+ Program binary disk cache, see programcache.h
+*/
+
+#include "programcache.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+const char PROGRAM_CACHE_MAGIC[8] = { 'G', 'L', 'P', 'R', 'O', 'G', '0', '1' };
+
+/* Far bigger than any real program binary, so a damaged length is never allocated */
+const unsigned int PROGRAM_CACHE_MAX_BINARY = 64 * 1024 * 1024;
+
+const unsigned long long FNV_OFFSET = 14695981039346656037ull;
+const unsigned long long FNV_PRIME = 1099511628211ull;
+
+static unsigned long long fnv1a(unsigned long long hash, const void *data, size_t length)
+{
+	const unsigned char *bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash = (hash ^ bytes[i]) * FNV_PRIME;
+	}
+	return hash;
+}
+
+
+/* Lengths are hashed before each string so that moving text from one to the next changes the hash */
+static unsigned long long hashString(unsigned long long hash, const string &text)
+{
+	unsigned long long length = text.size();
+	hash = fnv1a(hash, &length, sizeof(length));
+	return fnv1a(hash, text.data(), text.size());
+}
+
+
+ProgramCache::ProgramCache(const string &prefix)
+{
+	this->prefix = prefix;
+	enabled = true;
+	supported = -1;
+	hits = misses = rejected = 0;
+	quit = false;
+}
+
+
+/* Files still queued when the program ends without calling finish() are written before it exits */
+ProgramCache::~ProgramCache()
+{
+	finish();
+}
+
+
+bool ProgramCache::isEnabled()
+{
+	if (!enabled) return false;
+	if (supported < 0)
+	{
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		supported = formats > 0;
+	}
+	return supported != 0;
+}
+
+
+const string &ProgramCache::getDriver()
+{
+	if (driver.empty())
+	{
+		const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+		for (int i = 0; i < 3; i++)
+		{
+			const GLubyte *name = glGetString(names[i]);
+			driver += name ? (const char*)name : "";
+			driver += '\n';
+		}
+	}
+	return driver;
+}
+
+
+unsigned long long ProgramCache::getKey(const string &vertexSource, const string &fragmentSource)
+{
+	unsigned long long hash = hashString(FNV_OFFSET, getDriver());
+	hash = hashString(hash, vertexSource);
+	return hashString(hash, fragmentSource);
+}
+
+
+string ProgramCache::getPath(unsigned long long key) const
+{
+	char name[24];
+	snprintf(name, sizeof(name), "%016llx.bin", key);
+	return prefix + name;
+}
+
+
+shared_ptr<ProgramCacheRead> ProgramCache::prepareRead(unsigned long long key)
+{
+	if (!isEnabled()) return shared_ptr<ProgramCacheRead>();
+
+	shared_ptr<ProgramCacheRead> read = make_shared<ProgramCacheRead>();
+	read->path = getPath(key);
+	read->driver = getDriver();
+	read->key = key;
+	read->done = false;
+	read->found = false;
+	read->format = 0;
+	return read;
+}
+
+
+shared_ptr<ProgramCacheRead> ProgramCache::readAsync(unsigned long long key)
+{
+	shared_ptr<ProgramCacheRead> read = prepareRead(key);
+	if (!read) return read;
+
+	startThread();
+	{
+		lock_guard<mutex> lock(queueMutex);
+		reads.push_back(read);
+	}
+	wake.notify_one();
+	return read;
+}
+
+
+/* The file is the magic number, the key, the driver strings' length and text, the binary format, the binary's
+   length and the binary. A damaged file will be replaced when the program is stored again. One from another
+   driver whose hash collides is left for that driver */
+void ProgramCache::read(ProgramCacheRead &read)
+{
+	ifstream file(read.path.c_str(), ios::binary);
+	bool matches = file.is_open();
+
+	char magic[8];
+	unsigned long long storedKey = 0;
+	unsigned int driverLength = 0;
+	if (matches)
+	{
+		file.read(magic, sizeof(magic));
+		file.read((char*)&storedKey, sizeof(storedKey));
+		file.read((char*)&driverLength, sizeof(driverLength));
+		matches = file.good() && memcmp(magic, PROGRAM_CACHE_MAGIC, sizeof(magic)) == 0 && storedKey == read.key
+			&& driverLength == read.driver.size();
+	}
+	if (matches)
+	{
+		string storedDriver(driverLength, '\0');
+		file.read(&storedDriver[0], driverLength);
+		matches = file.good() && storedDriver == read.driver;
+	}
+
+	unsigned int length = 0;
+	if (matches)
+	{
+		file.read((char*)&read.format, sizeof(read.format));
+		file.read((char*)&length, sizeof(length));
+		if (file.good() && length > 0 && length <= PROGRAM_CACHE_MAX_BINARY)
+		{
+			read.binary.resize(length);
+			file.read(&read.binary[0], length);
+		}
+		matches = file.good() && !read.binary.empty();
+	}
+
+	read.found = matches;
+	if (!matches) read.binary.clear();
+	read.done.store(true, memory_order_release);
+}
+
+
+/* The driver can reject a binary it wrote, after an update for instance, so then the file is deleted */
+GLuint ProgramCache::createProgram(const ProgramCacheRead &read, bool &rejected)
+{
+	rejected = false;
+	if (!read.found) return 0;
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, read.format, &read.binary[0], (GLsizei)read.binary.size());
+
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status == GL_FALSE)
+	{
+		glDeleteProgram(program);
+		remove(read.path.c_str());
+		rejected = true;
+		return 0;
+	}
+	return program;
+}
+
+
+void ProgramCache::countLoad(bool hit, bool rejected)
+{
+	if (hit) hits++;
+	else misses++;
+	if (rejected) this->rejected++;
+}
+
+
+GLuint ProgramCache::load(unsigned long long key)
+{
+	shared_ptr<ProgramCacheRead> pending = prepareRead(key);
+	if (!pending) return 0;
+
+	read(*pending);
+	bool wasRejected;
+	GLuint program = createProgram(*pending, wasRejected);
+	countLoad(program != 0, wasRejected);
+	return program;
+}
+
+
+bool ProgramCache::getBinary(GLuint program, GLenum &format, vector<char> &binary)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0 || (unsigned int)length > PROGRAM_CACHE_MAX_BINARY) return false;
+
+	binary.resize(length);
+	format = 0;
+	glGetProgramBinary(program, length, NULL, &format, &binary[0]);
+	return true;
+}
+
+
+bool ProgramCache::store(unsigned long long key, GLuint program)
+{
+	if (!isEnabled()) return false;
+
+	GLenum format;
+	vector<char> binary;
+	if (!getBinary(program, format, binary)) return false;
+	return store(key, format, binary);
+}
+
+
+bool ProgramCache::store(unsigned long long key, GLenum format, vector<char> &binary)
+{
+	if (!isEnabled() || binary.empty()) return false;
+
+	PendingFile file;
+	file.path = getPath(key);
+	file.driver = getDriver();
+	file.key = key;
+	file.format = format;
+	file.binary = std::move(binary);
+	binary.clear();
+
+	startThread();
+	{
+		lock_guard<mutex> lock(queueMutex);
+		queue.push_back(std::move(file));
+	}
+	wake.notify_one();
+	return true;
+}
+
+
+void ProgramCache::startThread()
+{
+	if (!fileThread.joinable())
+	{
+		quit = false;
+		fileThread = thread(&ProgramCache::serviceFiles, this);
+	}
+}
+
+
+void ProgramCache::finish()
+{
+	if (fileThread.joinable())
+	{
+		{
+			lock_guard<mutex> lock(queueMutex);
+			quit = true;
+		}
+		wake.notify_one();
+		fileThread.join();
+	}
+}
+
+
+/* The file thread. Reads come first because a build is waiting for them. It only stops once both queues are
+   empty, so nothing stored is lost and every read is marked done */
+void ProgramCache::serviceFiles()
+{
+	for (;;)
+	{
+		shared_ptr<ProgramCacheRead> pending;
+		PendingFile file;
+		{
+			unique_lock<mutex> lock(queueMutex);
+			wake.wait(lock, [this]() { return quit || !queue.empty() || !reads.empty(); });
+			if (!reads.empty())
+			{
+				pending = reads.front();
+				reads.pop_front();
+			}
+			else if (!queue.empty())
+			{
+				file = std::move(queue.front());
+				queue.pop_front();
+			}
+			else return;
+		}
+
+		if (pending)
+			read(*pending);
+		else if (!writeFile(file))
+			cerr << "ProgramCache: couldn't write " << file.path << endl;
+	}
+}
+
+
+/* Written to a temporary file first, so a program being loaded by another run never sees half a file */
+bool ProgramCache::writeFile(const PendingFile &pending)
+{
+	string temporary = pending.path + ".tmp";
+	{
+		ofstream file(temporary.c_str(), ios::binary);
+		if (!file.is_open()) return false;
+
+		unsigned int driverLength = (unsigned int)pending.driver.size();
+		unsigned int binaryLength = (unsigned int)pending.binary.size();
+		file.write(PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+		file.write((const char*)&pending.key, sizeof(pending.key));
+		file.write((const char*)&driverLength, sizeof(driverLength));
+		file.write(pending.driver.data(), driverLength);
+		file.write((const char*)&pending.format, sizeof(pending.format));
+		file.write((const char*)&binaryLength, sizeof(binaryLength));
+		file.write(&pending.binary[0], binaryLength);
+		if (!file.good())
+		{
+			file.close();
+			remove(temporary.c_str());
+			return false;
+		}
+	}
+
+	// Windows won't rename over an existing file
+	remove(pending.path.c_str());
+	return rename(temporary.c_str(), pending.path.c_str()) == 0;
+}
@@ -0,0 +1,127 @@
+/* programcache.h
+ A disk cache of linked shader programs, so a program built once is loaded on later runs with
+ glProgramBinary instead of being compiled and linked from source again.
+
+ Each program is stored in its own file, named by a 64 bit FNV-1a hash of its shader sources and
+ the driver's vendor, renderer and version strings. The file repeats the driver strings and the
+ hash, so a file from another driver or one whose name collides is never used. A new driver
+ makes new names, and the old files are simply no longer read. If the driver rejects a binary,
+ which it may do after an update that kept the same version string, the file is deleted and the
+ program is built from source and stored again.
+
+ The cache turns itself off when the driver supports no program binary formats.
+
+ Files are read and written by a background thread. Storing a program only costs the frame
+ reading its binary back from the driver, and a thread with its own context can do that with
+ getBinary() and hand the binary over. Loading can be split the same way: readAsync() reads the
+ file on the cache's thread, or read() on any thread, and createProgram() gives the binary to the
+ driver on whichever context should own the program.
+*/
+
+#pragma once
+
+#include <glload/gl_4_0.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/* A cache file being read, by ProgramCache::read() on any thread. Everything the read needs is copied in
+   when it is made, and the results are only valid once done is set */
+struct ProgramCacheRead
+{
+	std::string path, driver;
+	unsigned long long key;
+	std::atomic<bool> done;
+	bool found;				// Whether the file exists and was written by this driver for this key
+	GLenum format;
+	std::vector<char> binary;
+};
+
+class ProgramCache
+{
+public:
+	/* Files are named prefix plus the hash. The prefix can include a directory, which must exist */
+	ProgramCache(const std::string &prefix = "programcache_");
+	~ProgramCache();
+
+	void setPrefix(const std::string &prefix) { this->prefix = prefix; }
+	void setEnabled(bool enabled) { this->enabled = enabled; }
+
+	/* False if turned off, or the driver can't save programs. Needs a current context */
+	bool isEnabled();
+
+	/* Hash of the sources and the driver, naming the cache file of the program built from them */
+	unsigned long long getKey(const std::string &vertexSource, const std::string &fragmentSource);
+
+	/* Create a linked program from the cache file for key, or return 0 if there is no usable one */
+	GLuint load(unsigned long long key);
+
+	/* load() in steps, so the file isn't read on the main thread. prepareRead() makes the read for key, or
+	   returns null if the cache is off, and needs a current context. readAsync() also queues it for the
+	   cache's thread. read() reads the file and sets done, and needs no context */
+	std::shared_ptr<ProgramCacheRead> prepareRead(unsigned long long key);
+	std::shared_ptr<ProgramCacheRead> readAsync(unsigned long long key);
+	static void read(ProgramCacheRead &read);
+
+	/* Give a finished read's binary to the driver, on any context sharing with the main one. Returns 0 if there
+	   was no file, or if the driver rejects it, which sets rejected and deletes the file. Report the outcome on
+	   the main thread with countLoad(), which load() does itself */
+	static GLuint createProgram(const ProgramCacheRead &read, bool &rejected);
+	void countLoad(bool hit, bool rejected);
+
+	/* Save a successfully linked program. It should have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+	   set, for drivers that only keep the binary when asked. The binary is read here and queued for the
+	   cache's thread. False if there is nothing to save */
+	bool store(unsigned long long key, GLuint program);
+
+	/* Queue a binary already read by getBinary(), on any context. The binary is moved from, leaving it empty */
+	bool store(unsigned long long key, GLenum format, std::vector<char> &binary);
+
+	/* Read a linked program's binary and its format. Only needs a context the program belongs to, so it can be
+	   called from another thread */
+	static bool getBinary(GLuint program, GLenum &format, std::vector<char> &binary);
+
+	/* Wait for the files queued so far to be read and written, then stop the cache's thread. The event loop calls
+	   this when it exits */
+	void finish();
+
+	unsigned int getHits() const { return hits; }
+	unsigned int getMisses() const { return misses; }
+	unsigned int getRejected() const { return rejected; }
+
+private:
+	/* A file waiting for the cache's thread, with everything it needs copied so the thread never reads the cache's
+	   members */
+	struct PendingFile
+	{
+		std::string path;
+		std::string driver;
+		unsigned long long key;
+		GLenum format;
+		std::vector<char> binary;
+	};
+
+	std::string getPath(unsigned long long key) const;
+	const std::string &getDriver();
+	void startThread();
+	void serviceFiles();
+	static bool writeFile(const PendingFile &file);
+
+	std::string prefix;
+	bool enabled;
+	int supported;			// -1 until the driver has been asked
+	std::string driver;		// Vendor, renderer and version strings, read when first needed
+	unsigned int hits, misses, rejected;
+
+	std::thread fileThread;
+	std::mutex queueMutex;
+	std::condition_variable wake;
+	std::deque<PendingFile> queue;
+	std::deque<std::shared_ptr<ProgramCacheRead> > reads;
+	bool quit;
+};
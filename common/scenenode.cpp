@@ -0,0 +1,133 @@
+/* scenenode.cpp
+ Retained scene graph node with cached world matrices, see scenenode.h
+*/
+
+#include "scenenode.h"
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+unsigned int SceneNode::worldUpdates = 0;
+
+SceneNode::SceneNode() : SceneNode(vec3(0.f))
+{
+}
+
+
+SceneNode::SceneNode(const vec3 &translation, const quat &rotation, const vec3 &scale) : local(translation, rotation, scale)
+{
+	worldDirty = true;
+	parent = NULL;
+}
+
+
+/* Detach from the graph so that neither the parent nor the children are left pointing at this node */
+SceneNode::~SceneNode()
+{
+	if (parent) parent->removeChild(this);
+	for (size_t i = 0; i < children.size(); i++)
+	{
+		children[i]->parent = NULL;
+		children[i]->markWorldDirty();
+	}
+}
+
+
+void SceneNode::addChild(SceneNode *child)
+{
+	if (child->parent) child->parent->removeChild(child);
+	child->parent = this;
+	children.push_back(child);
+	child->markWorldDirty();
+}
+
+
+void SceneNode::removeChild(SceneNode *child)
+{
+	vector<SceneNode*>::iterator found = find(children.begin(), children.end(), child);
+	if (found == children.end()) return;
+
+	children.erase(found);
+	child->parent = NULL;
+	child->markWorldDirty();
+}
+
+
+void SceneNode::setTransform(const Transform &transform)
+{
+	if (local == transform) return;
+	local = transform;
+	markWorldDirty();
+}
+
+
+void SceneNode::setTranslation(const vec3 &translation)
+{
+	if (local.translation == translation) return;
+	local.translation = translation;
+	markWorldDirty();
+}
+
+
+void SceneNode::setRotation(const quat &rotation)
+{
+	if (local.rotation == rotation) return;
+	local.rotation = rotation;
+	markWorldDirty();
+}
+
+
+void SceneNode::setScale(const vec3 &scale)
+{
+	if (local.scale == scale) return;
+	local.scale = scale;
+	markWorldDirty();
+}
+
+
+/* A dirty node's descendants are already dirty, so the walk stops at the first one it finds */
+void SceneNode::markWorldDirty()
+{
+	if (worldDirty) return;
+	worldDirty = true;
+	for (size_t i = 0; i < children.size(); i++)
+	{
+		children[i]->markWorldDirty();
+	}
+}
+
+
+/* Recalculate the world matrices from the parent's. The local transform is applied to the parent's matrix
+   directly, and the normal matrices multiply because transpose(inverse(A B)) = transpose(inverse(A)) *
+   transpose(inverse(B)), so neither a general 4x4 multiply nor an inverse is needed */
+void SceneNode::updateWorld()
+{
+	if (parent)
+	{
+		worldMatrix = local.concatenate(parent->getWorldMatrix());
+		worldNormalMatrix = parent->worldNormalMatrix * local.getNormalMatrix();
+	}
+	else
+	{
+		worldMatrix = local.getMatrix();
+		worldNormalMatrix = local.getNormalMatrix();
+	}
+	worldDirty = false;
+	worldUpdates++;
+}
+
+
+const mat4 &SceneNode::getWorldMatrix()
+{
+	if (worldDirty) updateWorld();
+	return worldMatrix;
+}
+
+
+/* The world normal matrix, transpose(inverse(mat3(world matrix))) */
+const mat3 &SceneNode::getWorldNormalMatrix()
+{
+	if (worldDirty) updateWorld();
+	return worldNormalMatrix;
+}
@@ -0,0 +1,65 @@
+/* scenenode.h
+ A node in a retained scene graph. Each node has a local Transform (translation, rotation and
+ scale) and caches its world matrix (parent world matrix * local matrix) and world normal matrix
+ (parent world normal matrix * local normal matrix, so no inverse is needed).
+ Changing a node's local transform marks it and everything below it as dirty, and the world
+ matrices are only recalculated for dirty nodes when they are next asked for, so a frame in
+ which nothing moves costs no matrix arithmetic however big the scene is.
+ Nodes don't own their children, which are normally globals or members that live as long as
+ the graph.
+*/
+
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "transform.h"
+
+class SceneNode
+{
+public:
+	SceneNode();
+	SceneNode(const glm::vec3 &translation, const glm::quat &rotation = glm::quat(1.f, 0.f, 0.f, 0.f), const glm::vec3 &scale = glm::vec3(1.f));
+	~SceneNode();
+
+	void addChild(SceneNode *child);
+	void removeChild(SceneNode *child);
+	SceneNode *getParent() const { return parent; }
+
+	/* Setting a value equal to the current one leaves the node clean */
+	void setTransform(const Transform &transform);
+	void setTranslation(const glm::vec3 &translation);
+	void setRotation(const glm::quat &rotation);
+	void setScale(const glm::vec3 &scale);
+
+	const Transform &getTransform() const { return local; }
+	const glm::vec3 &getTranslation() const { return local.translation; }
+	const glm::quat &getRotation() const { return local.rotation; }
+	const glm::vec3 &getScale() const { return local.scale; }
+
+	const glm::mat4 &getWorldMatrix();
+	const glm::mat3 &getWorldNormalMatrix();
+
+	/* Number of world matrices recalculated since the counter was last reset, across all nodes */
+	static unsigned int getWorldUpdates() { return worldUpdates; }
+	static void resetWorldUpdates() { worldUpdates = 0; }
+
+private:
+	// Nodes are linked by pointer so copying one would leave the graph inconsistent
+	SceneNode(const SceneNode &) = delete;
+	SceneNode &operator=(const SceneNode &) = delete;
+
+	void markWorldDirty();
+	void updateWorld();
+
+	Transform local;
+
+	glm::mat4 worldMatrix;
+	glm::mat3 worldNormalMatrix;
+	bool worldDirty;
+
+	SceneNode *parent;
+	std::vector<SceneNode*> children;
+
+	static unsigned int worldUpdates;
+};
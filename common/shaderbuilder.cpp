@@ -0,0 +1,366 @@
+/* shaderbuilder.cpp
+ Asynchronous shader program builds, see shaderbuilder.h
+*/
+
+#include "shaderbuilder.h"
+#include "wrapper_glfw.h"
+#include "frameuniforms.h"
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+/* From GL_KHR_parallel_shader_compile, which has the same values as the ARB extension */
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (APIENTRY *MaxShaderCompilerThreadsProc)(GLuint count);
+
+ShaderBuilder::ShaderBuilder()
+{
+	started = false;
+	mode = SHADER_BUILD_SYNC;
+	context = NULL;
+	quit = false;
+}
+
+
+/* The context has gone by now, finish() is where the worker is stopped while it still exists */
+ShaderBuilder::~ShaderBuilder()
+{
+	if (worker.joinable())
+	{
+		{
+			lock_guard<mutex> lock(queueMutex);
+			quit = true;
+		}
+		wake.notify_one();
+		worker.join();
+	}
+}
+
+
+/* Choose the mode. The worker's window is created here because GLFW only creates windows on the main thread */
+void ShaderBuilder::start()
+{
+	started = true;
+
+	if (glfwExtensionSupported("GL_KHR_parallel_shader_compile") || glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+	{
+		/* Let the driver use as many threads as it likes, if it asks to be told */
+		MaxShaderCompilerThreadsProc maxThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+		if (!maxThreads) maxThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+		if (maxThreads) maxThreads(0xffffffff);
+		mode = SHADER_BUILD_PARALLEL;
+		return;
+	}
+
+	/* The other window hints, the context version and profile, are still set from creating the main window */
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	context = glfwCreateWindow(1, 1, "Shader builder", NULL, glfwGetCurrentContext());
+	glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+	if (!context)
+	{
+		cerr << "ShaderBuilder: could not create a shared context, building shaders on the main thread" << endl;
+		mode = SHADER_BUILD_SYNC;
+		return;
+	}
+
+	mode = SHADER_BUILD_THREAD;
+	quit = false;
+	worker = thread(&ShaderBuilder::buildPrograms, this);
+}
+
+
+ProgramHandle ShaderBuilder::build(const string &vertexSource, const string &fragmentSource)
+{
+	if (!started) start();
+
+	ProgramHandle handle;
+	handle.build = make_shared<ProgramBuild>();
+	ProgramBuild &build = *handle.build;
+	build.program = build.vertexShader = build.fragmentShader = 0;
+	build.status = PROGRAM_PENDING;
+	build.linked = false;
+	build.succeeded = false;
+	build.binaryFormat = 0;
+	build.fromCache = build.rejected = false;
+
+	ProgramCache &cache = GLWrapper::programCache();
+	build.key = cache.getKey(vertexSource, fragmentSource);
+	build.cached = cache.isEnabled();
+	build.vertexSource = vertexSource;
+	build.fragmentSource = fragmentSource;
+
+	/* A program saved by an earlier run is used if there is one. Only the synchronous mode reads its file here,
+	   the others read it off the main thread and compile the program if there isn't a usable one */
+	switch (mode)
+	{
+	case SHADER_BUILD_PARALLEL:
+		build.cacheRead = cache.readAsync(build.key);
+		if (!build.cacheRead) compile(build);
+		pending.push_back(handle.build);
+		break;
+
+	case SHADER_BUILD_THREAD:
+		build.cacheRead = cache.prepareRead(build.key);
+		pending.push_back(handle.build);
+		{
+			lock_guard<mutex> lock(queueMutex);
+			queue.push_back(handle.build);
+		}
+		wake.notify_one();
+		break;
+
+	default:
+		build.program = cache.load(build.key);
+		build.fromCache = build.program != 0;
+		if (!build.fromCache) compile(build);
+		complete(build, build.fromCache || check(build));
+		break;
+	}
+	return handle;
+}
+
+
+/* Create the program from the binary of a finished cache read, on whichever thread's context is current. The
+   sources are only compiled if there was no usable binary */
+void ShaderBuilder::loadCached(ProgramBuild &build)
+{
+	build.program = ProgramCache::createProgram(*build.cacheRead, build.rejected);
+	build.fromCache = build.program != 0;
+	build.cacheRead.reset();
+}
+
+
+/* Start compiling and linking without asking for any results, so that a driver compiling in parallel
+   doesn't have to finish first */
+void ShaderBuilder::compile(ProgramBuild &build)
+{
+	const char *vertexText = build.vertexSource.c_str();
+	const char *fragmentText = build.fragmentSource.c_str();
+
+	build.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(build.vertexShader, 1, &vertexText, NULL);
+	glCompileShader(build.vertexShader);
+
+	build.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(build.fragmentShader, 1, &fragmentText, NULL);
+	glCompileShader(build.fragmentShader);
+
+	build.program = glCreateProgram();
+	glAttachShader(build.program, build.vertexShader);
+	glAttachShader(build.program, build.fragmentShader);
+	glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(build.program);
+}
+
+
+static void appendShaderLog(string &log, GLuint shader, const char *type)
+{
+	GLint status = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (status == GL_TRUE) return;
+
+	GLint length = 0;
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+	string text(length > 1 ? length : 1, '\0');
+	glGetShaderInfoLog(shader, (GLsizei)text.size(), NULL, &text[0]);
+	log += string("Compile error in ") + type + "\n\t" + text.c_str() + "\n";
+}
+
+
+/* Read the results of compile(), which waits for them if they aren't ready. The shaders are no longer needed
+   once the program is linked */
+bool ShaderBuilder::check(ProgramBuild &build)
+{
+	GLint status = GL_FALSE;
+	glGetProgramiv(build.program, GL_LINK_STATUS, &status);
+	if (status == GL_FALSE)
+	{
+		appendShaderLog(build.log, build.vertexShader, "vertex");
+		appendShaderLog(build.log, build.fragmentShader, "fragment");
+
+		GLint length = 0;
+		glGetProgramiv(build.program, GL_INFO_LOG_LENGTH, &length);
+		string text(length > 1 ? length : 1, '\0');
+		glGetProgramInfoLog(build.program, (GLsizei)text.size(), NULL, &text[0]);
+		build.log += string("Linker error: ") + text.c_str() + "\n";
+	}
+
+	glDeleteShader(build.vertexShader);
+	glDeleteShader(build.fragmentShader);
+	build.vertexShader = build.fragmentShader = 0;
+	return status == GL_TRUE;
+}
+
+
+/* On the main thread, make a finished build ready to use or report why it failed. A program that didn't come
+   from the cache is saved to it. The worker has already read the binary in thread mode, otherwise reading it is
+   left for a later poll() */
+void ShaderBuilder::complete(ProgramBuild &build, bool succeeded)
+{
+	ProgramCache &cache = GLWrapper::programCache();
+	if (build.cached && mode != SHADER_BUILD_SYNC) cache.countLoad(build.fromCache, build.rejected);
+
+	if (succeeded)
+	{
+		bindUniformBlocks(build.program);
+		if (build.cached && !build.fromCache)
+		{
+			if (mode == SHADER_BUILD_THREAD)
+				cache.store(build.key, build.binaryFormat, build.binary);
+			else
+				unsaved.push_back(UnsavedProgram(build.key, build.program));
+		}
+		build.status = PROGRAM_READY;
+	}
+	else
+	{
+		cerr << build.log;
+		glDeleteProgram(build.program);
+		build.program = 0;
+		build.status = PROGRAM_FAILED;
+	}
+	build.vertexSource.clear();
+	build.fragmentSource.clear();
+}
+
+
+/* Reading a program's binary back is a round trip to the driver, so only one program completed in an earlier
+   frame is saved each frame */
+void ShaderBuilder::poll()
+{
+	if (!unsaved.empty())
+	{
+		GLWrapper::programCache().store(unsaved.front().first, unsaved.front().second);
+		unsaved.pop_front();
+	}
+
+	for (size_t i = 0; i < pending.size(); )
+	{
+		ProgramBuild &build = *pending[i];
+		bool finished;
+		if (mode == SHADER_BUILD_PARALLEL)
+		{
+			/* Once the cache's thread has read the file, load the binary, or start compiling without one */
+			if (build.cacheRead)
+			{
+				if (!build.cacheRead->done.load(memory_order_acquire))
+				{
+					i++;
+					continue;
+				}
+				loadCached(build);
+				if (!build.fromCache) compile(build);
+			}
+
+			if (build.fromCache)
+			{
+				finished = build.succeeded = true;
+			}
+			else
+			{
+				GLint done = GL_FALSE;
+				glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &done);
+				finished = done == GL_TRUE;
+				if (finished) build.succeeded = check(build);
+			}
+		}
+		else
+		{
+			finished = build.linked.load(memory_order_acquire);
+		}
+
+		if (!finished)
+		{
+			i++;
+			continue;
+		}
+		complete(build, build.succeeded);
+		pending.erase(pending.begin() + i);
+	}
+}
+
+
+void ShaderBuilder::waitAll()
+{
+	poll();
+	while (!pending.empty())
+	{
+		this_thread::sleep_for(chrono::milliseconds(1));
+		poll();
+	}
+}
+
+
+void ShaderBuilder::finish()
+{
+	if (worker.joinable())
+	{
+		{
+			lock_guard<mutex> lock(queueMutex);
+			quit = true;
+			queue.clear();
+		}
+		wake.notify_one();
+		worker.join();
+	}
+	if (context)
+	{
+		glfwDestroyWindow(context);
+		context = NULL;
+	}
+	pending.clear();
+
+	/* Nothing is waiting for a frame any more, so save everything that hasn't been */
+	while (!unsaved.empty())
+	{
+		GLWrapper::programCache().store(unsaved.front().first, unsaved.front().second);
+		unsaved.pop_front();
+	}
+}
+
+
+/* The worker thread. The cache file is read and given to the driver here, and a built program's binary read back
+   for the cache, so that none of it happens on the main thread. glFinish makes sure the program is complete
+   before the main context is told it can use it */
+void ShaderBuilder::buildPrograms()
+{
+	glfwMakeContextCurrent(context);
+	for (;;)
+	{
+		shared_ptr<ProgramBuild> build;
+		{
+			unique_lock<mutex> lock(queueMutex);
+			wake.wait(lock, [this]() { return quit || !queue.empty(); });
+			if (quit) break;
+			build = queue.front();
+			queue.pop_front();
+		}
+
+		if (build->cacheRead)
+		{
+			ProgramCache::read(*build->cacheRead);
+			loadCached(*build);
+		}
+
+		if (build->fromCache)
+		{
+			build->succeeded = true;
+		}
+		else
+		{
+			compile(*build);
+			build->succeeded = check(*build);
+			if (build->succeeded && build->cached)
+			{
+				ProgramCache::getBinary(build->program, build->binaryFormat, build->binary);
+			}
+		}
+		glFinish();
+		build->linked.store(true, memory_order_release);
+	}
+	glfwMakeContextCurrent(NULL);
+}
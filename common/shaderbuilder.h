@@ -0,0 +1,139 @@
+/* shaderbuilder.h
+ Builds shader programs without making the render loop wait for the compiler. A build returns a
+ ProgramHandle straight away. The handle becomes ready some frames later, and until then the
+ renderer draws with a fallback program of its own choosing.
+
+ The builder uses the first of these that the driver supports:
+	GL_KHR_parallel_shader_compile or GL_ARB_parallel_shader_compile. The driver compiles and links
+	on its own threads, and GL_COMPLETION_STATUS_KHR is polled each frame so that asking for the
+	status never blocks.
+	A worker thread with a hidden window whose context shares objects with the main one. The
+	worker compiles, links and checks the program and reads its binary for the program cache,
+	then calls glFinish so the program is complete before the main context uses it.
+	Building on the main thread when the build is asked for, as LoadShader does, if the shared
+	context can't be created.
+
+ Programs saved in GLWrapper::programCache() by an earlier run are loaded instead of built:
+	In thread mode the worker reads the file and gives the binary to the driver on its context.
+	In parallel mode the cache's thread reads the file and poll() gives the binary to the driver,
+	which only costs the frame glProgramBinary and the link status query. Some drivers recompile
+	the program there.
+	In synchronous mode build() loads it, as LoadShader does.
+ Built programs have their uniform blocks bound on the main thread when they become ready and are
+ handed to the cache, whose own thread writes the file. Reading a program's binary back with
+ glGetProgramBinary is a round trip to the driver that can take a millisecond or more for a large
+ program. The worker does it in thread mode. In the other modes poll() does it a frame after the
+ program is ready, for at most one program a frame, and finish() saves any still left.
+ The event loop calls poll() at the start of each frame.
+*/
+
+#pragma once
+
+#include <glload/gl_4_0.h>
+#include "programcache.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+struct GLFWwindow;
+
+enum ProgramStatus
+{
+	PROGRAM_PENDING,
+	PROGRAM_READY,
+	PROGRAM_FAILED
+};
+
+enum ShaderBuildMode
+{
+	SHADER_BUILD_SYNC,
+	SHADER_BUILD_PARALLEL,
+	SHADER_BUILD_THREAD
+};
+
+/* One program being built. The worker thread only writes program, succeeded, log, fromCache, rejected and the
+   binary, and reads cacheRead, before it sets linked */
+struct ProgramBuild
+{
+	std::string vertexSource, fragmentSource;
+	unsigned long long key;
+	GLuint program, vertexShader, fragmentShader;
+	ProgramStatus status;
+	std::atomic<bool> linked;
+	bool succeeded;
+	std::string log;
+	bool cached;					// Whether the program cache is on, decided on the main thread
+	std::shared_ptr<ProgramCacheRead> cacheRead;	// The cache file, until the binary in it is loaded
+	bool fromCache, rejected;		// Whether the program was loaded from the cache or its binary was refused
+	GLenum binaryFormat;
+	std::vector<char> binary;		// Read by the worker for the program cache
+};
+
+/* Refers to a program being built. Copies refer to the same build. Only use it on the main thread */
+class ProgramHandle
+{
+public:
+	ProgramStatus getStatus() const { return build ? build->status : PROGRAM_FAILED; }
+	bool isReady() const { return getStatus() == PROGRAM_READY; }
+	bool hasFailed() const { return getStatus() == PROGRAM_FAILED; }
+
+	/* The program once it is ready, otherwise the fallback */
+	GLuint getOr(GLuint fallback) const { return isReady() ? build->program : fallback; }
+
+private:
+	friend class ShaderBuilder;
+	std::shared_ptr<ProgramBuild> build;
+};
+
+class ShaderBuilder
+{
+public:
+	ShaderBuilder();
+	~ShaderBuilder();
+
+	/* Start building a program from vertex and fragment shader source. Needs the main context to be current.
+	   The first build chooses the mode */
+	ProgramHandle build(const std::string &vertexSource, const std::string &fragmentSource);
+
+	/* Finish any builds that have completed. The event loop calls this once a frame */
+	void poll();
+
+	/* Block until every build so far is ready or has failed, for when there is nothing to draw without them */
+	void waitAll();
+
+	/* Stop the worker thread and close its context. Builds not yet started are abandoned. The event loop calls
+	   this when it exits */
+	void finish();
+
+	ShaderBuildMode getMode() const { return mode; }
+	unsigned int getPending() const { return (unsigned int)pending.size(); }
+
+private:
+	void start();
+	void compile(ProgramBuild &build);
+	bool check(ProgramBuild &build);
+	void complete(ProgramBuild &build, bool succeeded);
+	void loadCached(ProgramBuild &build);
+	void buildPrograms();
+
+	/* Built programs to save to the cache once their binaries have been read, oldest first */
+	typedef std::pair<unsigned long long, GLuint> UnsavedProgram;
+	std::deque<UnsavedProgram> unsaved;
+
+	bool started;
+	ShaderBuildMode mode;
+	std::vector<std::shared_ptr<ProgramBuild> > pending;
+
+	/* Thread mode: the worker's context and the builds waiting for it */
+	GLFWwindow *context;
+	std::thread worker;
+	std::mutex queueMutex;
+	std::condition_variable wake;
+	std::deque<std::shared_ptr<ProgramBuild> > queue;
+	bool quit;
+};
@@ -5,10 +5,12 @@
 */
 
 #include "sphere.h"
+#include <algorithm>
 
 /* I don't like using namespaces in header files but have less issues with them in
 seperate cpp files */
 using namespace std;
+using namespace glm;
 
 /* Define the vertex attributes for vertex positions and normals.
 Make these match your application and vertex shader
@@ -19,6 +21,10 @@ Sphere::Sphere()
 	attribute_v_colours = 1;
 	attribute_v_normal = 2;
 	numspherevertices = 0;		// We set this when we know the numlats and numlongs values in makeSphere
+	numindices = 0;
+	numlats = numlongs = 0;
+	numlods = 0;
+	resetLODStats();
 }
 
 Sphere::~Sphere()
@@ -26,102 +32,139 @@ Sphere::~Sphere()
 }
 
 
-/* Make a sphere from two triangle fans (one at each pole) and triangle strips along latitudes */
-/* This version uses indexed vertex buffers for both the fans at the poles and the latitude strips */
+/* Build the full detail sphere now. The lower levels of detail are built when they are first drawn */
 void Sphere::makeSphere(GLuint numlats, GLuint numlongs)
 {
-	GLuint i, j;
-	/* Calculate the number of vertices required in sphere */
-	GLuint numvertices = 2 + ((numlats - 1) * numlongs);
-
 	// Store the number of sphere vertices in an attribute because we need it later when drawing it
-	numspherevertices = numvertices;
+	numspherevertices = 2 + ((numlats - 1) * numlongs);
 	this->numlats = numlats;
 	this->numlongs = numlongs;
 
+	// Each level of detail halves the latitudes and longitudes until the next would drop below the minimum
+	numlods = 1;
+	while (numlods < SPHERE_MAX_LODS && (numlats >> numlods) >= SPHERE_MIN_LATS && (numlongs >> numlods) >= SPHERE_MIN_LONGS)
+	{
+		numlods++;
+	}
+	for (GLuint i = 0; i < SPHERE_MAX_LODS; i++)
+	{
+		lodIndices[i] = 0;
+	}
+
+	mesh = lods[0] = defineMesh(numlats, numlongs, numindices);
+	lodIndices[0] = numindices;
+}
+
+
+/* The outline is a circle of numlongs segments seen from a pole, and a meridian of 2 * numlats segments
+   seen side on, so a level has the fewer of the two */
+GLuint Sphere::getLODSegments(GLuint lod) const
+{
+	if (lod >= numlods) lod = numlods - 1;
+	return std::min(numlongs >> lod, (numlats >> lod) * 2);
+}
+
+
+/* Choose the coarsest level of detail that still has at least the requested number of segments */
+GLuint Sphere::selectLOD(GLuint segments) const
+{
+	GLuint lod = 0;
+	while (lod + 1 < numlods && getLODSegments(lod + 1) >= segments)
+	{
+		lod++;
+	}
+	return lod;
+}
+
+
+MeshHandle Sphere::getMesh(GLuint lod)
+{
+	if (lod >= numlods) lod = numlods - 1;
+	if (lodIndices[lod] == 0)
+	{
+		lods[lod] = defineMesh(numlats >> lod, numlongs >> lod, lodIndices[lod]);
+	}
+	return lods[lod];
+}
+
+
+/* Make a sphere from a single indexed triangle list so that the whole sphere is drawn in one call.
+   The triangles are ordered cap, latitude bands from north to south, then the other cap, so vertices are
+   reused by neighbouring triangles while they are still in the post-transform cache */
+MeshHandle Sphere::defineMesh(GLuint numlats, GLuint numlongs, GLuint &numindices)
+{
+	GLuint i, j;
+	/* Calculate the number of vertices required in sphere */
+	GLuint numvertices = 2 + ((numlats - 1) * numlongs);
+
 	// Create the temporary arrays to stro
 	GLfloat* pVertices = new GLfloat[numvertices * 3];
-	GLfloat* pColours = new GLfloat[numvertices * 4];
-	makeUnitSphere(pVertices);
+	PackedVertex* pPacked = new PackedVertex[numvertices];
+	makeUnitSphere(pVertices, numlats, numlongs);
 
-	/* Define colours as the x,y,z components of the sphere vertices */
+	/* Interleave the vertices into the packed format. On a unit sphere the normal is the same as the
+	   position, and the colours are defined as the x,y,z components of the sphere vertices */
 	for (i = 0; i < numvertices; i++)
 	{
-		pColours[i * 4] = pVertices[i * 3];
-		pColours[i * 4 + 1] = pVertices[i * 3 + 1];
-		pColours[i * 4 + 2] = pVertices[i * 3 + 2];
-		pColours[i * 4 + 3] = 1.f;
+		vec3 position(pVertices[i * 3], pVertices[i * 3 + 1], pVertices[i * 3 + 2]);
+		pPacked[i] = packVertex(position, position, vec4(position, 1.f));
 	}
 
-	/* Generate the vertex buffer object */
-	glGenBuffers(1, &sphereBufferObject);
-	glBindBuffer(GL_ARRAY_BUFFER, sphereBufferObject);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)* numvertices * 3, pVertices, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	/* Store the normals in a buffer object */
-	glGenBuffers(1, &sphereNormals);
-	glBindBuffer(GL_ARRAY_BUFFER, sphereNormals);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)* numvertices * 3, pVertices, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	/* Store the colours in a buffer object */
-	glGenBuffers(1, &sphereColours);
-	glBindBuffer(GL_ARRAY_BUFFER, sphereColours);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)* numvertices * 4, pColours, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	/* Calculate the number of indices in our index array and allocate memory for it */
-	GLuint numindices = ((numlongs * 2) + 2) * (numlats - 1) + ((numlongs + 2) * 2);
+	/* Calculate the number of indices in our index array and allocate memory for it.
+	   Each longitude contributes one triangle to each polar cap and two to each of the numlats - 2 bands */
+	numindices = numlongs * 6 * (numlats - 1);
 	GLuint* pindices = new GLuint[numindices];
 
-	// fill "indices" to define triangle strips
 	GLuint index = 0;		// Current index
 
-	// Define indices for the first triangle fan for one pole
-	for (i = 0; i < numlongs + 1; i++)
+	// Define the triangles around the north pole
+	for (i = 0; i < numlongs; i++)
 	{
-		pindices[index++] = i;
+		pindices[index++] = 0;
+		pindices[index++] = 1 + i;
+		pindices[index++] = 1 + (i + 1) % numlongs;
 	}
-	pindices[index++] = 1;	// Join last triangle in the triangle fan
 
+	// Define two triangles for each quad along each latitude band
 	GLuint start = 1;		// Start index for each latitude row
 	for (j = 0; j < numlats - 2; j++)
 	{
 		for (i = 0; i < numlongs; i++)
 		{
+			GLuint next = (i + 1) % numlongs;
 			pindices[index++] = start + i;
 			pindices[index++] = start + i + numlongs;
-		}
-		pindices[index++] = start; // close the triangle strip loop by going back to the first vertex in the loop
-		pindices[index++] = start + numlongs; // close the triangle strip loop by going back to the first vertex in the loop
+			pindices[index++] = start + next;
 
+			pindices[index++] = start + next;
+			pindices[index++] = start + i + numlongs;
+			pindices[index++] = start + next + numlongs;
+		}
 		start += numlongs;
 	}
 
-	// Define indices for the last triangle fan for the south pole region
-	for (i = numvertices - 1; i > (numvertices - numlongs - 2); i--)
+	// Define the triangles around the south pole, start is now the first vertex of the last latitude row
+	for (i = 0; i < numlongs; i++)
 	{
-		pindices[index++] = i;
+		pindices[index++] = numvertices - 1;
+		pindices[index++] = start + (i + 1) % numlongs;
+		pindices[index++] = start + i;
 	}
-	pindices[index] = numvertices - 2;	// Tie up last triangle in fan
 
-	// Generate a buffer for the indices
-	glGenBuffers(1, &elementbuffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, numindices * sizeof(GLuint), pindices, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	// Copy the vertices and indices into the shared mesh buffer
+	MeshHandle mesh = GLWrapper::meshes().add(pPacked, numvertices, pindices, numindices);
 
-	delete pindices;
-	delete pColours;
-	delete pVertices;
+	delete[] pindices;
+	delete[] pPacked;
+	delete[] pVertices;
+	return mesh;
 }
 
 
 /* Define the vertex positions for a sphere. The array of vertices must have previosuly
 been created.
 */
-void Sphere::makeUnitSphere(GLfloat *pVertices)
+void Sphere::makeUnitSphere(GLfloat *pVertices, GLuint numlats, GLuint numlongs)
 {
 	GLfloat DEG_TO_RADIANS = 3.141592f / 180.f;
 	GLuint vnum = 0;
@@ -134,12 +177,15 @@ void Sphere::makeUnitSphere(GLfloat *pVertices)
 	GLfloat latstep = 180.f / numlats;
 	GLfloat longstep = 360.f / numlongs;
 
-	/* Define vertices along latitude lines */
-	for (GLfloat lat = 90.f - latstep; lat > -90.f; lat -= latstep)
+	/* Define vertices along latitude lines. The loops count rows and columns rather than stepping
+	   the angles so that rounding can never add an extra row or column to the vertex array */
+	for (GLuint j = 1; j < numlats; j++)
 	{
+		GLfloat lat = 90.f - latstep * j;
 		lat_radians = lat * DEG_TO_RADIANS;
-		for (GLfloat lon = -180.f; lon < 180.f; lon += longstep)
+		for (GLuint i = 0; i < numlongs; i++)
 		{
+			GLfloat lon = -180.f + longstep * i;
 			lon_radians = lon * DEG_TO_RADIANS;
 
 			x = cos(lat_radians) * cos(lon_radians);
@@ -156,59 +202,29 @@ void Sphere::makeUnitSphere(GLfloat *pVertices)
 }
 
 /* Draws the sphere form the previously defined vertex and index buffers */
-void Sphere::drawSphere(int drawmode)
+void Sphere::drawSphere(int drawmode, GLuint lod)
 {
-	GLuint i;
-
-	/* Draw the vertices as GL_POINTS */
-	glBindBuffer(GL_ARRAY_BUFFER, sphereBufferObject);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(0);
-
-	/* Bind the sphere normals */
-	glEnableVertexAttribArray(2);
-	glBindBuffer(GL_ARRAY_BUFFER, sphereNormals);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	if (lod >= numlods) lod = numlods - 1;
+	MeshHandle lodMesh = getMesh(lod);
+	lodStats.add(lod, 1, lodIndices[lod] / 3);
 
-	/* Bind the sphere colours */
-	glBindBuffer(GL_ARRAY_BUFFER, sphereColours);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, 0);
-	glEnableVertexAttribArray(1);
-
-	glPointSize(3.f);
+	GLWrapper::state().pointSize(3.f);
 
 	// Enable this line to show model in wireframe
 	if (drawmode == 1)
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	else
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-
-	if (drawmode == 2)
-	{
-		glDrawArrays(GL_POINTS, 0, numspherevertices);
-	}
+		GLWrapper::state().polygonMode(GL_LINE);
 	else
-	{
-		/* Bind the indexed vertex buffer */
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
+		GLWrapper::state().polygonMode(GL_FILL);
 
-		/* Draw the north pole regions as a triangle fan*/
-		glDrawElements(GL_TRIANGLE_FAN, numlongs + 2, GL_UNSIGNED_INT, (GLvoid*)(0));
-
-		/* Calculate offsets into the indexed array. Note that we multiply offsets by 4
-		because it is a memory offset, the indices are type GLuint which is 4-bytes */
-		GLuint lat_offset_jump = (numlongs * 2) + 2;
-		GLuint lat_offset_start = numlongs + 2;
-		GLuint lat_offset_current = lat_offset_start * 4;
+	/* Draw the whole sphere in one call from its range of the shared mesh buffer */
+	GLWrapper::meshes().draw(lodMesh, drawmode == 2 ? GL_POINTS : GL_TRIANGLES);
+}
 
-		/* Draw the triangle strips of latitudes */
-		unsigned int max_lat = numlats - 2;
-		for (i = 0; i < max_lat; i++)
-		{
-			glDrawElements(GL_TRIANGLE_STRIP, numlongs * 2 + 2, GL_UNSIGNED_INT, (GLvoid*)(lat_offset_current));
-			lat_offset_current += (lat_offset_jump * 4);
-		}
-		/* Draw the south pole as a triangle fan */
-		glDrawElements(GL_TRIANGLE_FAN, numlongs + 2, GL_UNSIGNED_INT, (GLvoid*)(lat_offset_current));
-	}
+/* Add the sphere to this frame's batch instead of drawing it now, see MeshBuffer::drawBatch */
+void Sphere::batchSphere(const mat4 &model, const mat3 &normal, GLuint lod)
+{
+	if (lod >= numlods) lod = numlods - 1;
+	MeshHandle lodMesh = getMesh(lod);
+	lodStats.add(lod, 1, lodIndices[lod] / 3);
+	GLWrapper::meshes().addToBatch(lodMesh, model, normal);
 }
\ No newline at end of file
@@ -2,14 +2,24 @@
  Example class to create a generic sphere object
  Resolution can be controlled by setting the number of latitudes and longitudes
  Iain Martin November 2018
+
+ Each sphere has a chain of levels of detail, each with half the latitudes and longitudes of the one
+ before, which are only built the first time they are drawn. The level is chosen per draw.
 */
 
 #pragma once
 
 #include "wrapper_glfw.h"
+#include "vertexformat.h"
+#include "meshbuffer.h"
+#include "lodselect.h"
 #include <vector>
 #include <glm/glm.hpp>
 
+const GLuint SPHERE_MIN_LATS = 2;
+const GLuint SPHERE_MIN_LONGS = 3;
+const GLuint SPHERE_MAX_LODS = LOD_MAX_LEVELS;
+
 class Sphere
 {
 public:
@@ -17,22 +27,38 @@ public:
 	~Sphere();
 
 	void makeSphere(GLuint numlats, GLuint numlongs);
-	void drawSphere(int drawmode);
+	void drawSphere(int drawmode, GLuint lod = 0);
+	void batchSphere(const glm::mat4 &model, const glm::mat3 &normal, GLuint lod = 0);
+
+	/* The sphere's mesh in the shared mesh buffer at a level of detail */
+	MeshHandle getMesh(GLuint lod = 0);
 
-	// Define vertex buffer object names (e.g as globals)
-	GLuint sphereBufferObject;
-	GLuint sphereNormals;
-	GLuint sphereColours;
-	GLuint elementbuffer;
+	GLuint getNumLODs() const { return numlods; }
+	GLuint getLODSegments(GLuint lod) const;
+	GLuint selectLOD(GLuint segments) const;
+
+	/* Instances and triangles drawn at each level of detail since the last reset */
+	const LODStats &getLODStats() const { return lodStats; }
+	void resetLODStats() { lodStats.reset(); }
+
+	// The sphere's full detail vertices and indices in the shared mesh buffer, set in makeSphere
+	MeshHandle mesh;
 
 	GLuint attribute_v_coord;
 	GLuint attribute_v_normal;
 	GLuint attribute_v_colours;
 
 	int numspherevertices;
+	GLuint numindices;
 	int numlats;
 	int numlongs;
 
 private:
-	void makeUnitSphere(GLfloat *pVertices);
+	static MeshHandle defineMesh(GLuint numlats, GLuint numlongs, GLuint &numindices);
+	static void makeUnitSphere(GLfloat *pVertices, GLuint numlats, GLuint numlongs);
+
+	GLuint numlods;
+	MeshHandle lods[SPHERE_MAX_LODS];
+	GLuint lodIndices[SPHERE_MAX_LODS];	// Zero until the level has been built
+	LODStats lodStats;
 };
@@ -0,0 +1,82 @@
+/* transform.cpp
+ Translate/rotate/scale transform with closed form matrices, see transform.h
+*/
+
+#include "transform.h"
+
+using namespace glm;
+
+Transform::Transform() : Transform(vec3(0.f))
+{
+}
+
+
+Transform::Transform(const vec3 &translation, const quat &rotation, const vec3 &scale)
+{
+	this->translation = translation;
+	this->rotation = rotation;
+	this->scale = scale;
+}
+
+
+mat4 Transform::getMatrix() const
+{
+	mat3 r = mat3_cast(rotation);
+	return mat4(vec4(r[0] * scale.x, 0.f),
+				vec4(r[1] * scale.y, 0.f),
+				vec4(r[2] * scale.z, 0.f),
+				vec4(translation, 1.f));
+}
+
+
+/* Inverting a rotation is a transpose and inverting a scale is a reciprocal. The rows of R^T are the columns
+   of R, and S^-1 on the left divides row i by scale i */
+mat4 Transform::getInverseMatrix() const
+{
+	mat3 r = mat3_cast(rotation);
+	vec3 inv = 1.f / scale;
+
+	mat3 m;
+	for (int c = 0; c < 3; c++)
+	{
+		m[c] = vec3(r[0][c], r[1][c], r[2][c]) * inv;
+	}
+	return mat4(vec4(m[0], 0.f), vec4(m[1], 0.f), vec4(m[2], 0.f), vec4(-(m * translation), 1.f));
+}
+
+
+/* transpose(inverse(R S)) = transpose(S^-1 R^T) = R S^-1, so each column of R is divided by its scale */
+mat3 Transform::getNormalMatrix() const
+{
+	mat3 r = mat3_cast(rotation);
+	r[0] /= scale.x;
+	r[1] /= scale.y;
+	r[2] /= scale.z;
+	return r;
+}
+
+
+mat4 Transform::concatenate(const mat4 &parent) const
+{
+	mat3 r = mat3_cast(rotation);
+	mat3 p(parent);
+
+	return mat4(vec4(p * (r[0] * scale.x), 0.f),
+				vec4(p * (r[1] * scale.y), 0.f),
+				vec4(p * (r[2] * scale.z), 0.f),
+				vec4(p * translation + vec3(parent[3]), 1.f));
+}
+
+
+Transform Transform::operator*(const Transform &child) const
+{
+	return Transform(translation + rotation * (scale * child.translation),
+					 rotation * child.rotation,
+					 scale * child.scale);
+}
+
+
+bool Transform::operator==(const Transform &other) const
+{
+	return translation == other.translation && rotation == other.rotation && scale == other.scale;
+}
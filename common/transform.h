@@ -0,0 +1,40 @@
+/* transform.h
+ A translation, rotation (quaternion) and non-uniform scale, applied as translate * rotate * scale.
+ Because the parts are kept separate the matrix, its inverse and the normal matrix can all be
+ written down directly instead of going through a general 4x4 multiply or a general inverse:
+   matrix         = [ R S | t ]
+   inverse        = [ S^-1 R^T | -S^-1 R^T t ]
+   normal matrix  = transpose(inverse(R S)) = R S^-1
+*/
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+class Transform
+{
+public:
+	glm::vec3 translation;
+	glm::quat rotation;
+	glm::vec3 scale;
+
+	Transform();
+	Transform(const glm::vec3 &translation, const glm::quat &rotation = glm::quat(1.f, 0.f, 0.f, 0.f), const glm::vec3 &scale = glm::vec3(1.f));
+
+	glm::mat4 getMatrix() const;
+	glm::mat4 getInverseMatrix() const;
+	glm::mat3 getNormalMatrix() const;
+
+	/* parent * getMatrix() for an affine parent matrix (bottom row 0, 0, 0, 1), without the work a general
+	   4x4 multiply spends on the bottom row */
+	glm::mat4 concatenate(const glm::mat4 &parent) const;
+
+	/* The transform of a child in this transform's space, as one transform. Translate/rotate/scale isn't closed
+	   under composition, so this is exact only when this transform's scale is uniform or the child has no
+	   rotation. Otherwise the result has no shear, so it only approximates the true product */
+	Transform operator*(const Transform &child) const;
+
+	bool operator==(const Transform &other) const;
+	bool operator!=(const Transform &other) const { return !(*this == other); }
+};
@@ -0,0 +1,53 @@
+/* vertexformat.cpp
+ Packing functions for the compact interleaved vertex format
+*/
+
+#include "vertexformat.h"
+#include <cstddef>
+
+using namespace glm;
+
+/* Convert a value in [-1, 1] to a 10-bit two's complement signed normalised integer */
+static GLuint packSnorm10(GLfloat value)
+{
+	value = clamp(value, -1.f, 1.f);
+	GLint scaled = (GLint)round(value * 511.f);
+	return (GLuint)scaled & 0x3FF;
+}
+
+GLuint packNormal(const vec3 &normal)
+{
+	vec3 n = normal;
+	GLfloat len = length(n);
+	if (len > 0) n /= len;
+
+	return packSnorm10(n.x) | (packSnorm10(n.y) << 10) | (packSnorm10(n.z) << 20);
+}
+
+PackedVertex packVertex(const vec3 &position, const vec3 &normal, const vec4 &colour)
+{
+	PackedVertex vertex;
+	vertex.position[0] = position.x;
+	vertex.position[1] = position.y;
+	vertex.position[2] = position.z;
+	vertex.normal = packNormal(normal);
+	for (int i = 0; i < 4; i++)
+	{
+		vertex.colour[i] = (GLubyte)round(clamp(colour[i], 0.f, 1.f) * 255.f);
+	}
+	return vertex;
+}
+
+void setPackedVertexAttribs(GLuint attribute_v_coord, GLuint attribute_v_colours, GLuint attribute_v_normal)
+{
+	GLsizei stride = sizeof(PackedVertex);
+
+	glEnableVertexAttribArray(attribute_v_coord);
+	glVertexAttribPointer(attribute_v_coord, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(PackedVertex, position));
+
+	glEnableVertexAttribArray(attribute_v_colours);
+	glVertexAttribPointer(attribute_v_colours, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(PackedVertex, colour));
+
+	glEnableVertexAttribArray(attribute_v_normal);
+	glVertexAttribPointer(attribute_v_normal, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)offsetof(PackedVertex, normal));
+}
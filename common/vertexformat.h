@@ -0,0 +1,30 @@
+/* vertexformat.h
+ Compact interleaved vertex format shared by the Cube, Sphere and Cylinder objects.
+ Each vertex is stored in one buffer as a float position followed by a normal packed into
+ GL_INT_2_10_10_10_REV and an RGBA8 colour, 20 bytes in total instead of the 36-40 bytes of
+ separate float position, normal and colour buffers.
+ The packed normal and colour are normalised by the vertex fetch so the shader still receives
+ a vec3 normal and a vec4 colour in the [-1, 1] and [0, 1] ranges.
+*/
+
+#pragma once
+
+#include "wrapper_glfw.h"
+#include <glm/glm.hpp>
+
+struct PackedVertex
+{
+	GLfloat position[3];
+	GLuint normal;		// x, y, z as signed 10-bit normalised values, w unused
+	GLubyte colour[4];	// r, g, b, a as unsigned 8-bit normalised values
+};
+
+/* Pack a normal into the 2_10_10_10 signed normalised format. The normal is normalised first */
+GLuint packNormal(const glm::vec3 &normal);
+
+/* Build a packed vertex from a position, normal and colour. Colour components are clamped to [0, 1] */
+PackedVertex packVertex(const glm::vec3 &position, const glm::vec3 &normal, const glm::vec4 &colour);
+
+/* Point the position, colour and normal attributes at the PackedVertex array in the currently bound
+   GL_ARRAY_BUFFER and enable them */
+void setPackedVertexAttribs(GLuint attribute_v_coord, GLuint attribute_v_colours, GLuint attribute_v_normal);
@@ -6,23 +6,38 @@
   */
 
 #include "wrapper_glfw.h"
+#include "frameuniforms.h"
+#include "meshbuffer.h"
 
 /* Inlcude some standard headers */
 
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <algorithm>
 
 using namespace std;
 
+/* The most simulated time the update callback catches up on in one frame. After a longer stall, like
+   a breakpoint or dragging the window, the rest is dropped rather than run all at once */
+const double MAX_UPDATE_CATCHUP = 0.25;
+
 /* Constructor for wrapper object */
-GLWrapper::GLWrapper(int width, int height, const char *title) {
+GLWrapper::GLWrapper(int width, int height, const char *title, bool headless) {
 
 	this->width = width;
 	this->height = height;
 	this->title = title;
-	this->fps = 60;
 	this->running = true;
+	this->renderer = NULL;
+	this->interpolatedRenderer = NULL;
+	this->updater = NULL;
+	this->updateTimestep = 1.0 / 60.0;
+	timings.updates = 0;
+	timings.updateTime = timings.renderTime = 0;
+	this->headless = headless;
+	framebuffer = colourbuffer = depthbuffer = 0;
+	maxFrames = 0;
 
 	/* Initialise GLFW and exit if it fails */
 	if (!glfwInit()) 
@@ -31,7 +46,11 @@ GLWrapper::GLWrapper(int width, int height, const char *title) {
 		exit(EXIT_FAILURE);
 	}
 
-	glfwWindowHint(GLFW_SAMPLES, 8);
+	/* Multisampling only applies to the window, which isn't drawn into when headless */
+	if (headless)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	else
+		glfwWindowHint(GLFW_SAMPLES, 8);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -42,6 +61,7 @@ GLWrapper::GLWrapper(int width, int height, const char *title) {
 	window = glfwCreateWindow(width, height, title, 0, 0);
 	if (!window){
 		cout << "Could not open GLFW window." << endl;
+		if (headless) cout << "Headless mode still needs a window system for GLFW, such as Xvfb." << endl;
 		glfwTerminate();
 		exit(EXIT_FAILURE);
 	}
@@ -61,6 +81,40 @@ GLWrapper::GLWrapper(int width, int height, const char *title) {
 	glfwSetWindowTitle(window, title);
 
 	glfwSetInputMode(window, GLFW_STICKY_KEYS, true);
+
+	/* Wait for the vertical blank rather than drawing frames that are never seen. Headless frames are never
+	   swapped so there is nothing to wait for */
+	pacer().setSwapMode(headless ? SWAP_IMMEDIATE : SWAP_VSYNC);
+
+	if (headless) createFramebuffer();
+}
+
+
+/* The render target for headless mode: colour and depth renderbuffers the size of the window, bound in place
+   of the window's framebuffer */
+void GLWrapper::createFramebuffer()
+{
+	glGenRenderbuffers(1, &colourbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colourbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+	glGenRenderbuffers(1, &depthbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colourbuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthbuffer);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		cerr << "Could not create the headless framebuffer. Exiting" << endl;
+		glfwTerminate();
+		exit(EXIT_FAILURE);
+	}
+	glViewport(0, 0, width, height);
 }
 
 
@@ -76,6 +130,64 @@ GLFWwindow* GLWrapper::getWindow()
 }
 
 
+/* There is one OpenGL context so there is one state cache */
+GLStateCache &GLWrapper::state()
+{
+	static GLStateCache cache;
+	return cache;
+}
+
+
+/* Per-draw constants ring, sized for a few hundred draws per frame */
+ConstantRing &GLWrapper::constants()
+{
+	static ConstantRing ring;
+	return ring;
+}
+
+
+MeshBuffer &GLWrapper::meshes()
+{
+	static MeshBuffer buffer;
+	return buffer;
+}
+
+
+FramePacer &GLWrapper::pacer()
+{
+	static FramePacer framePacer;
+	return framePacer;
+}
+
+
+Profiler &GLWrapper::profiler()
+{
+	static Profiler frameProfiler;
+	return frameProfiler;
+}
+
+
+FrameCapture &GLWrapper::capture()
+{
+	static FrameCapture frameCapture;
+	return frameCapture;
+}
+
+
+ProgramCache &GLWrapper::programCache()
+{
+	static ProgramCache cache;
+	return cache;
+}
+
+
+ShaderBuilder &GLWrapper::shaderBuilder()
+{
+	static ShaderBuilder builder;
+	return builder;
+}
+
+
 /*
  * Print OpenGL Version details
  */
@@ -97,20 +209,87 @@ void GLWrapper::DisplayVersion()
 /*
 GLFW_Main function normally starts the windows system, calls any init routines
 and then starts the event loop which runs until the program ends
+
+If an update callback is registered it runs at a fixed timestep, however fast frames are rendered.
+The time since the last frame is added to an accumulator and the update runs once for each whole
+timestep in it. The remainder as a fraction of a timestep is passed to the renderer as alpha, to
+draw that far between the last two updates.
 */
 int GLWrapper::eventLoop()
 {
+	double previous = glfwGetTime();
+	double accumulator = 0;
+	unsigned int frames = 0;
+
 	// Main loop
-	while (!glfwWindowShouldClose(window))
+	while (!glfwWindowShouldClose(window) && (maxFrames == 0 || frames < maxFrames))
 	{
+		frames++;
+
+		double now = glfwGetTime();
+		double elapsed = now - previous;
+		previous = now;
+
+		profiler().beginFrame();
+		shaderBuilder().poll();
+
+		timings.updates = 0;
+		if (updater)
+		{
+			ProfileScope scope(profiler(), "update");
+			accumulator += std::min(elapsed, MAX_UPDATE_CATCHUP);
+			while (accumulator >= updateTimestep)
+			{
+				updater(updateTimestep);
+				accumulator -= updateTimestep;
+				timings.updates++;
+			}
+		}
+		double updated = glfwGetTime();
+		timings.updateTime = (updated - now) * 1000.0;
+
 		// Call function to draw your graphics
-		renderer();
+		{
+			ProfileScope scope(profiler(), "render", PROFILE_CPU_GPU);
+			state().beginFrame();
+			constants().beginFrame();
+			if (interpolatedRenderer)
+				interpolatedRenderer(updater ? accumulator / updateTimestep : 1.0);
+			else
+				renderer();
+			constants().endFrame();
+		}
+		timings.renderTime = (glfwGetTime() - updated) * 1000.0;
 
-		// Swap buffers
-		glfwSwapBuffers(window);
+		// Start reading back the finished frame if it is being captured, before the swap leaves it undefined
+		{
+			ProfileScope scope(profiler(), "capture");
+			int w = width, h = height;
+			if (!headless) glfwGetFramebufferSize(window, &w, &h);
+			capture().captureFrame(framebuffer, w, h);
+		}
+
+		// Wait for the frame's deadline if the frame rate is limited, then swap buffers
+		{
+			ProfileScope scope(profiler(), "pace");
+			pacer().waitForDeadline();
+		}
+		{
+			// Headless frames stay in the framebuffer object, so just make sure the commands are sent
+			ProfileScope scope(profiler(), "swap");
+			if (headless)
+				glFlush();
+			else
+				glfwSwapBuffers(window);
+		}
+		pacer().endFrame();
 		glfwPollEvents();
 	}
 
+	capture().finish();
+	shaderBuilder().finish();
+	programCache().finish();
+	profiler().exportCSV();
 	glfwTerminate();
 	return 0;
 }
@@ -125,6 +304,19 @@ void GLWrapper::setErrorCallback(void(*func)(int error, const char* description)
 /* Register a display function that renders in the window */
 void GLWrapper::setRenderer(void(*func)()) {
 	this->renderer = func;
+	this->interpolatedRenderer = NULL;
+}
+
+/* Register a display function that is given how far between the last two updates to draw */
+void GLWrapper::setRenderer(void(*func)(double alpha)) {
+	this->interpolatedRenderer = func;
+	this->renderer = NULL;
+}
+
+/* Register a function that advances the animation by a fixed timestep, in seconds */
+void GLWrapper::setUpdate(void(*func)(double timestep), double updatesPerSecond) {
+	this->updater = func;
+	this->updateTimestep = 1.0 / updatesPerSecond;
 }
 
 /* Register a callback that runs after the window gets resized */
@@ -208,6 +400,15 @@ GLuint GLWrapper::LoadShader(const char *vertex_path, const char *fragment_path)
 	string vertShaderStr = readFile(vertex_path);
 	string fragShaderStr = readFile(fragment_path);
 
+	// Use the program saved by an earlier run if there is one
+	unsigned long long key = programCache().getKey(vertShaderStr, fragShaderStr);
+	GLuint cached = programCache().load(key);
+	if (cached)
+	{
+		bindUniformBlocks(cached);
+		return cached;
+	}
+
 	GLint result = GL_FALSE;
 	int logLength;
 
@@ -218,6 +419,7 @@ GLuint GLWrapper::LoadShader(const char *vertex_path, const char *fragment_path)
 	GLuint program = glCreateProgram();
 	glAttachShader(program, vertShader);
 	glAttachShader(program, fragShader);
+	glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(program);
 
 	glGetProgramiv(program, GL_LINK_STATUS, &result);
@@ -225,6 +427,10 @@ GLuint GLWrapper::LoadShader(const char *vertex_path, const char *fragment_path)
 	vector<char> programError((logLength > 1) ? logLength : 1);
 	glGetProgramInfoLog(program, logLength, NULL, &programError[0]);
 	cout << &programError[0] << endl;
+	if (result == GL_TRUE) programCache().store(key, program);
+
+	// Share the per-frame uniform buffer with this program
+	bindUniformBlocks(program);
 
 	glDeleteShader(vertShader);
 	glDeleteShader(fragShader);
@@ -238,6 +444,14 @@ GLuint GLWrapper::BuildShaderProgram(string vertShaderStr, string fragShaderStr)
 	GLuint vertShader, fragShader;
 	GLint result = GL_FALSE;
 
+	unsigned long long key = programCache().getKey(vertShaderStr, fragShaderStr);
+	GLuint cached = programCache().load(key);
+	if (cached)
+	{
+		bindUniformBlocks(cached);
+		return cached;
+	}
+
 	try
 	{
 		vertShader = BuildShader(GL_VERTEX_SHADER, vertShaderStr);
@@ -252,6 +466,7 @@ GLuint GLWrapper::BuildShaderProgram(string vertShaderStr, string fragShaderStr)
 	GLuint program = glCreateProgram();
 	glAttachShader(program, vertShader);
 	glAttachShader(program, fragShader);
+	glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(program);
 
 	GLint status;
@@ -269,9 +484,24 @@ GLuint GLWrapper::BuildShaderProgram(string vertShaderStr, string fragShaderStr)
 		delete[] strInfoLog;
 		throw runtime_error("Shader could not be linked.");
 	}
+	programCache().store(key, program);
+
+	// Share the per-frame uniform buffer with this program
+	bindUniformBlocks(program);
 	
 	glDeleteShader(vertShader);
 	glDeleteShader(fragShader);
 
 	return program;
+}
+
+/* Read the shaders here and build the program in the background */
+ProgramHandle GLWrapper::LoadShaderAsync(const char *vertex_path, const char *fragment_path)
+{
+	return shaderBuilder().build(readFile(vertex_path), readFile(fragment_path));
+}
+
+ProgramHandle GLWrapper::BuildShaderProgramAsync(const string &vertShaderStr, const string &fragShaderStr)
+{
+	return shaderBuilder().build(vertShaderStr, fragShaderStr);
 }
\ No newline at end of file
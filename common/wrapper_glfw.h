@@ -12,29 +12,62 @@ Iain Martin August 2014
 #include <glload/gl_load.h>
 #include <GLFW/glfw3.h>
 
+#include "glstatecache.h"
+#include "constantring.h"
+#include "framepacer.h"
+#include "profiler.h"
+#include "framecapture.h"
+#include "programcache.h"
+#include "shaderbuilder.h"
+
+class MeshBuffer;
+
+/* What the event loop spent its CPU time on in the last frame, in milliseconds */
+struct LoopTimings
+{
+	unsigned int updates;	// Fixed timestep updates run before the frame was rendered
+	double updateTime;
+	double renderTime;		// The render callback, not including the wait for the GPU or the swap
+};
+
 class GLWrapper {
 private:
 
 	int width;
 	int height;
 	const char *title;
-	double fps;
 	void(*renderer)();
+	void(*interpolatedRenderer)(double alpha);
+	void(*updater)(double timestep);
+	double updateTimestep;
+	LoopTimings timings;
 	bool running;
 	GLFWwindow* window;
 
+	bool headless;
+	GLuint framebuffer, colourbuffer, depthbuffer;
+	unsigned int maxFrames;
+
+	void createFramebuffer();
+
 public:
-	GLWrapper(int width, int height, const char *title);
+	/* With headless set the window is never shown and everything is drawn into a framebuffer object of the
+	   window's size instead, which stays bound as the draw framebuffer. This needs no display to look at,
+	   and runs on a software renderer like Mesa's llvmpipe. GLFW still needs a window system to create the
+	   context, which can be a virtual one like Xvfb or a GLFW built with GLFW_USE_OSMESA */
+	GLWrapper(int width, int height, const char *title, bool headless = false);
 	~GLWrapper();
 
-	void setFPS(double fps) {
-		this->fps = fps;
-	}
+	/* Limit the event loop to fps frames per second, or 0 for no limit other than the swap interval. The limit
+	   is kept by the frame pacer, pacer().getTargetFPS() reads it back */
+	void setFPS(double fps) { pacer().setTargetFPS(fps); }
 
 	void DisplayVersion();
 
 	/* Callback registering functions */
 	void setRenderer(void(*f)());
+	void setRenderer(void(*f)(double alpha));
+	void setUpdate(void(*f)(double timestep), double updatesPerSecond = 60);
 	void setReshapeCallback(void(*f)(GLFWwindow* window, int w, int h));
 	void setKeyCallback(void(*f)(GLFWwindow* window, int key, int scancode, int action, int mods));
 	void setErrorCallback(void(*f)(int error, const char* description));
@@ -43,10 +76,54 @@ public:
 	GLuint LoadShader(const char *vertex_path, const char *fragment_path);
 	GLuint BuildShader(GLenum eShaderType, const std::string &shaderText);
 	GLuint BuildShaderProgram(std::string vertShaderStr, std::string fragShaderStr);
+
+	/* The same, but return at once with a handle that becomes ready when the program has been built in the
+	   background. Draw with a fallback program until then, see shaderbuilder.h */
+	ProgramHandle LoadShaderAsync(const char *vertex_path, const char *fragment_path);
+	ProgramHandle BuildShaderProgramAsync(const std::string &vertShaderStr, const std::string &fragShaderStr);
 	std::string readFile(const char *filePath);
 
 	int eventLoop();
 	GLFWwindow* getWindow();
+
+	bool isHeadless() const { return headless; }
+	GLuint getFramebuffer() const { return framebuffer; }	// 0, the window's own, unless headless
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+	/* Stop the event loop after this many frames, or 0 to run until the window is closed. A headless
+	   window can't be closed so this, or glfwSetWindowShouldClose, is how it ends */
+	void setMaxFrames(unsigned int frames) { maxFrames = frames; }
+
+	LoopTimings getLoopTimings() const { return timings; }
+
+	/* Shared OpenGL state cache. Use this instead of calling the GL functions it covers directly */
+	static GLStateCache &state();
+
+	/* Shared ring buffer for per-draw constants. The event loop starts and ends its frames */
+	static ConstantRing &constants();
+
+	/* Vertex and index buffers shared by all the mesh objects, see meshbuffer.h */
+	static MeshBuffer &meshes();
+
+	/* Swap interval and frame rate limiter used by the event loop, see framepacer.h */
+	static FramePacer &pacer();
+
+	/* CPU and GPU timing of the phases of each frame, see profiler.h. The event loop times the update, render,
+	   pace and swap phases */
+	static Profiler &profiler();
+
+	/* Records frames to image files without stalling, see framecapture.h. The event loop reads back each frame
+	   before it is swapped while capture is started */
+	static FrameCapture &capture();
+
+	/* Linked programs saved to disk. LoadShader and BuildShaderProgram load from it when they can, and save
+	   what they build to it, see programcache.h */
+	static ProgramCache &programCache();
+
+	/* Builds programs without blocking the event loop, which finishes completed builds at the start of each
+	   frame. See shaderbuilder.h */
+	static ShaderBuilder &shaderBuilder();
 };
 
 
@@ -23,6 +23,8 @@ if you prefer */
 #include "wrapper_glfw.h"
 #include <iostream>
 #include <stack>
+#include <cstring>
+#include <cstdlib>
 
 /* Include GLM core and matrix extensions*/
 #include <glm/glm.hpp>
@@ -33,8 +35,13 @@ if you prefer */
 #include "sphere.h"
 #include "cube.h"
 #include "cylinder.h"
-#include "cylinderCigar.h"
-#include "cylinderRed.h"
+#include "scenenode.h"
+#include "frameuniforms.h"
+#include "meshbuffer.h"
+#include "frustumcull.h"
+#include "occlusioncull.h"
+#include "lodselect.h"
+#include "assignment1.h"
 
 // Including headers for Assimp
 #include <assimp/Importer.hpp>
@@ -48,8 +55,31 @@ const int NUM_PROGRAMS = 3;
 
 GLuint program[NUM_PROGRAMS];		/* Identifiers for the shader prgorams */
 GLuint current_program;
-GLuint vao;			/* Vertex array (Containor) object. This is the index of the VAO that will be the container for
-					   our buffer objects */
+
+/* The lit program is built in the background so the window opens straight away. Until it is ready the
+   scene is drawn with the unlit program[0], which is small enough to build at once */
+ProgramHandle litProgram;
+
+const char *unlitVertexSource =
+	"#version 400\n"
+	"layout(location = 0) in vec3 position;\n"
+	"layout(location = 1) in vec4 colour;\n"
+	"layout(location = 3) in mat4 instancemodel;\n"
+	"layout(location = 7) in vec4 tint;\n"
+	"out vec4 fcolour;\n"
+	"layout(std140) uniform FrameUniforms { mat4 view; mat4 projection; vec4 lightpos; uint colourmode; uint attenuationmode; };\n"
+	"layout(std140) uniform DrawUniforms { mat4 model; mat3 normalmatrix; uint emitmode; uint instanced; };\n"
+	"void main()\n"
+	"{\n"
+	"	fcolour = colour * tint;\n"
+	"	gl_Position = projection * view * (instanced == 1 ? instancemodel : model) * vec4(position, 1.0);\n"
+	"}\n";
+
+const char *unlitFragmentSource =
+	"#version 400\n"
+	"in vec4 fcolour;\n"
+	"out vec4 outputColor;\n"
+	"void main() { outputColor = fcolour; }\n";
 
 GLuint colourmode;	/* Index of a uniform to switch the colour mode in the vertex shader
 					  I've included this to show you how to pass in an unsigned integer into
@@ -62,16 +92,24 @@ GLfloat angle_x, angle_inc_x, x, model_scale, z, y, vx, vy, vz;
 GLfloat angle_y, angle_inc_y, angle_z, angle_inc_z;
 GLfloat openLid, openLid_inc;
 
+/* The animated values before the last update. Frames are drawn between these and the current values */
+GLfloat last_angle_x, last_angle_y, last_angle_z, last_openLid;
+
+const double UPDATES_PER_SECOND = 60;	// The animation increments are per update
+GLWrapper *glwrapper;					// For the key callback to read the loop timings
+
 GLuint drawmode;			// Defines drawing mode of sphere as points, lines or filled polygons
 GLuint numlats, numlongs;	//Define the resolution of the sphere object
 
 GLfloat light_x, light_y, light_z;
 
-/* Uniforms*/
-GLuint modelID[NUM_PROGRAMS], viewID[NUM_PROGRAMS], projectionID[NUM_PROGRAMS], lightposID[NUM_PROGRAMS], normalmatrixID[NUM_PROGRAMS];
-GLuint colourmodeID[NUM_PROGRAMS], emitmodeID[NUM_PROGRAMS], attenuationmodeID[NUM_PROGRAMS];
+/* View, projection, light position, colourmode and attenuationmode are the same for every object and every
+   program, so they are sent once per frame in a uniform buffer shared by all the programs */
+FrameUniforms frameUniforms;
+FrameUniformBuffer frameUniformBuffer;
 
 GLfloat aspect_ratio;		/* Aspect ratio of the window defined in the reshape callback*/
+GLfloat viewportHeight;		/* Height of the window in pixels, for choosing levels of detail */
 GLuint numspherevertices;
 
 Cube aCube;
@@ -79,8 +117,118 @@ Cube brownCube;
 Cube darkBrownCube;
 Sphere aSphere;
 Cylinder aCylinder;
-CylinderCigar aCylinderCigar;
-CylinderRed aCylinderRed;
+Cylinder aCylinderCigar(vec3(0.52f, 0.32f, 0.24f));
+
+/* Positions of the cigars in the box. Each cigar has a band 0.15 units along its length */
+const int NUM_CIGARS = 9;
+const vec3 cigarPositions[NUM_CIGARS] =
+{
+	vec3(0, -0.4f, 0), vec3(0.1f, -0.4f, 0), vec3(0.2f, -0.4f, 0), vec3(-0.1f, -0.4f, 0), vec3(-0.2f, -0.4f, 0),
+	vec3(0.05f, -0.315f, 0), vec3(0.15f, -0.315f, 0), vec3(-0.05f, -0.315f, 0), vec3(-0.15f, -0.315f, 0)
+};
+
+/* Per-instance data for drawing the cigars (first NUM_CIGARS entries) and their bands (the rest)
+   together in one instanced draw */
+mat4 cigarModels[NUM_CIGARS * 2];
+mat3 cigarNormals[NUM_CIGARS * 2];
+vec4 cigarColours[NUM_CIGARS * 2];
+
+/* Scene graph for the cigar box, built once in buildScene(). The box node carries the global rotation and
+   scale and the lid hangs from a hinge node rotated by openLid. Everything else is fixed relative to the box
+   so its world matrix is only recalculated when the box itself moves */
+SceneNode lightNode;
+SceneNode boxNode;
+SceneNode baseNode, leftNode, rightNode, backNode, frontNode;
+SceneNode lidHingeNode, lidNode;
+SceneNode leftHingeNode, rightHingeNode;
+SceneNode cigarNodes[NUM_CIGARS], bandNodes[NUM_CIGARS];
+
+/* The nodes drawn with their own draw call. Their model matrices and eye space normal matrices are gathered
+   into drawnModels and drawnNormals each frame */
+enum DrawnNode
+{
+	DRAW_LIGHT, DRAW_BASE, DRAW_LEFT, DRAW_RIGHT, DRAW_BACK, DRAW_FRONT, DRAW_LID,
+	DRAW_LEFT_HINGE, DRAW_RIGHT_HINGE, NUM_DRAWN_NODES
+};
+SceneNode *drawnNodes[NUM_DRAWN_NODES] =
+{
+	&lightNode, &baseNode, &leftNode, &rightNode, &backNode, &frontNode, &lidNode,
+	&leftHingeNode, &rightHingeNode
+};
+mat4 drawnModels[NUM_DRAWN_NODES];
+mat3 drawnNormals[NUM_DRAWN_NODES];
+
+/* The drawn nodes and the cigars and bands are culled against the view frustum each frame. The culler holds
+   the drawn nodes first, in DrawnNode order, then the cigars and bands in the order of cigarModels */
+FrustumCuller culler;
+
+/* The box sides and lid are drawn into a small depth buffer on the CPU, then the cigars and bands that
+   passed the frustum test are tested against it, so they aren't drawn while the lid is shut */
+OcclusionCuller occlusion;
+
+/* The sphere and cylinders are drawn at the coarsest level of detail whose outline is within the pixel
+   error of a true circle at their size on screen */
+LODSelector lodSelector;
+
+
+/* Set up the static parts of the scene graph. These are the translate/rotate/scale chains that
+   display() used to apply to a matrix stack every frame */
+void buildScene()
+{
+	lightNode.setScale(vec3(0.05f, 0.05f, 0.05f));
+
+	boxNode.addChild(&baseNode);
+	baseNode.setTranslation(vec3(0, -0.5f, 0));
+	baseNode.setScale(vec3(3, 0.2, 3));
+
+	boxNode.addChild(&leftNode);
+	leftNode.setTranslation(vec3(-0.75f, -0.3f, 0));
+	leftNode.setScale(vec3(0.2, 1, 3));
+
+	boxNode.addChild(&rightNode);
+	rightNode.setTranslation(vec3(0.75f, -0.3f, 0));
+	rightNode.setScale(vec3(0.2, 1, 3));
+
+	boxNode.addChild(&backNode);
+	backNode.setTranslation(vec3(0, -0.3f, -0.7f));
+	backNode.setScale(vec3(3, 1, 0.2));
+
+	boxNode.addChild(&frontNode);
+	frontNode.setTranslation(vec3(0, -0.3f, 0.7f));
+	frontNode.setScale(vec3(3, 1, 0.2));
+
+	// The lid pivots about the hinge line at the back of the box
+	boxNode.addChild(&lidHingeNode);
+	lidHingeNode.setTranslation(vec3(0, -0.05, -0.75));
+	lidHingeNode.addChild(&lidNode);
+	lidNode.setTranslation(vec3(0, 0.05, 0.75));
+	lidNode.setScale(vec3(3.2, 0.2, 3));
+
+	quat hingeRotation = angleAxis(radians(90.0f), vec3(0, 0, 1));
+	boxNode.addChild(&leftHingeNode);
+	leftHingeNode.setTranslation(vec3(-0.75, -0.05, -0.75));
+	leftHingeNode.setRotation(hingeRotation);
+	leftHingeNode.setScale(vec3(0.1, 0.05, 0.1));
+
+	boxNode.addChild(&rightHingeNode);
+	rightHingeNode.setTranslation(vec3(0.75, -0.05, -0.75));
+	rightHingeNode.setRotation(hingeRotation);
+	rightHingeNode.setScale(vec3(0.1, 0.05, 0.1));
+
+	quat cigarRotation = angleAxis(radians(90.0f), vec3(1, 0, 0));
+	for (int i = 0; i < NUM_CIGARS; i++)
+	{
+		boxNode.addChild(&cigarNodes[i]);
+		cigarNodes[i].setTranslation(cigarPositions[i]);
+		cigarNodes[i].setRotation(cigarRotation);
+		cigarNodes[i].setScale(vec3(0.05, 0.5, 0.05));
+
+		boxNode.addChild(&bandNodes[i]);
+		bandNodes[i].setTranslation(cigarPositions[i] + vec3(0, 0, 0.15f));
+		bandNodes[i].setRotation(cigarRotation);
+		bandNodes[i].setScale(vec3(0.051, 0.05, 0.051));
+	}
+}
 
 
 /*
@@ -97,6 +245,7 @@ void init(GLWrapper *glw)
 	light_y = 0.3; light_z = 0; light_x = 0.9;
 	angle_x = angle_y = angle_z = openLid = 0;
 	angle_inc_x = angle_inc_y = angle_inc_z = openLid = 0;const float roughness = 0.8;
+	last_angle_x = last_angle_y = last_angle_z = last_openLid = 0;
 	model_scale = 1.f;
 	aspect_ratio = 1.3333f;
 	colourmode = 0; 
@@ -106,17 +255,15 @@ void init(GLWrapper *glw)
 	numlongs = 40;		// Number of longitudes in our sphere
 
 
-	// Generate index (name) for one vertex array object
-	glGenVertexArrays(1, &vao);
-
-	// Create the vertex array object and make it current
-	glBindVertexArray(vao);
+	/* Every object's mesh is drawn through the two vertex array objects shared by GLWrapper::meshes(), one for
+	   single draws and one for instanced and batched draws, so there is no VAO to create here */
 
 	/* Load and build the vertex and fragment shaders */
 	try
 	{
-		//program[0] = glw->LoadShader("..\\..\\shaders\\poslight.vert", "..\\..\\shaders\\poslight.frag");
-		program[1] = glw->LoadShader("..\\..\\shaders\\fraglight.vert", "..\\..\\shaders\\fraglight.frag");
+		program[0] = glw->BuildShaderProgram(unlitVertexSource, unlitFragmentSource);
+		litProgram = glw->LoadShaderAsync("..\\..\\shaders\\fraglight.vert", "..\\..\\shaders\\fraglight.frag");
+		program[1] = program[0];
 		//program[2] = glw->LoadShader("..\\..\\shaders\\fraglight.vert", "..\\..\\shaders\\fraglight_oren_nayar.frag");
 	}
 	catch (exception &e)
@@ -126,30 +273,35 @@ void init(GLWrapper *glw)
 		exit(0);
 	}
 
-	/* Define the same uniforms to send to both shaders */
-	for (int i = 0; i < NUM_PROGRAMS; i++)
-	{
-		glUseProgram(program[i]);
-		modelID[i] = glGetUniformLocation(program[i], "model");
-		colourmodeID[i] = glGetUniformLocation(program[i], "colourmode");
-		emitmodeID[i] = glGetUniformLocation(program[i], "emitmode");
-		attenuationmodeID[i] = glGetUniformLocation(program[i], "attenuationmode");
-		viewID[i] = glGetUniformLocation(program[i], "view");
-		projectionID[i] = glGetUniformLocation(program[i], "projection");
-		lightposID[i] = glGetUniformLocation(program[i], "lightpos");
-		normalmatrixID[i] = glGetUniformLocation(program[i], "normalmatrix");
-	}
+	/* The per-object values are sent in the DrawUniforms block through GLWrapper::constants(), so there are
+	   no uniform locations to look up */
 	// Define the index which represents the current shader (i.e. default is gouraud)
 	current_program = 1;
 
+	/* Create the per-frame uniform buffer, the programs were attached to its binding point when they were linked */
+	frameUniformBuffer.create();
+
 	/* create our sphere and cube objects */
 	aSphere.makeSphere(numlats, numlongs);
 	aCube.makeCube(0);
 	brownCube.makeCube(1);
 	darkBrownCube.makeCube(2);
 	aCylinder.makeCylinder();
-	aCylinderCigar.makeCylinderCigar();
-	aCylinderRed.makeCylinderRed();
+	aCylinderCigar.makeCylinder();
+
+	int width, height;
+	glfwGetFramebufferSize(glw->getWindow(), &width, &height);
+	viewportHeight = (GLfloat)height;
+
+	buildScene();
+
+	/* The cigar and band colours don't change so fill them in once. Both are drawn with the cigar
+	   cylinder because every cylinder of the same shape shares its geometry */
+	for (int i = 0; i < NUM_CIGARS; i++)
+	{
+		cigarColours[i] = vec4(0.52f, 0.32f, 0.24f, 1.f);
+		cigarColours[NUM_CIGARS + i] = vec4(1.f, 0.f, 0.f, 1.f);
+	}
 
 	cout << "The Key Controls attempt to follow a logical control:" << endl;
 	cout << "" << endl;
@@ -180,32 +332,47 @@ void init(GLWrapper *glw)
 	cout << "Animation Controls" << endl;
 	cout << "Arrow Key Up: Open The Box" << endl;
 	cout << "Arrow Key Down: Close The Box" << endl;
+	cout << "" << endl;
+	cout << "Diagnostics" << endl;
+	cout << "P: Print The OpenGL State Calls Issued And Skipped Last Frame" << endl;
+	cout << "[: Coarser Levels Of Detail (Larger Pixel Error)" << endl;
+	cout << "]: Finer Levels Of Detail (Smaller Pixel Error)" << endl;
+	cout << "V: Cycle Vertical Sync Off, On And Adaptive" << endl;
+	cout << "M: Cycle The Frame Rate Limit Off, 30, 60 And 120 FPS" << endl;
+}
+
+/* Send the model matrix of a drawn node and its normal matrix (gathered in display()) to the current shader */
+void setModelUniforms(DrawnNode node)
+{
+	DrawUniforms draw;
+	draw.model = drawnModels[node];
+	draw.setNormalMatrix(drawnNormals[node]);
+	draw.emitmode = emitmode;
+	draw.instanced = 0;
+	GLWrapper::constants().pushUniforms(DRAW_UNIFORMS_BINDING, &draw, sizeof(draw));
 }
 
 /* Called to update the display. Note that this function is called in the event loop in the wrapper
-   class because we registered display as a callback function */
-void display()
+   class because we registered display as a callback function. alpha is how far the frame is between
+   the last two updates */
+void display(double alpha)
 {
+	/* State changes go through the state cache so the ones that are the same every frame are skipped */
+	GLStateCache &gl = GLWrapper::state();
+
 	/* Define the background colour */
-	glClearColor(0.75, 0.75, 0.75, 1.0f);
+	gl.clearColor(0.75, 0.75, 0.75, 1.0f);
 
 	/* Clear the colour and frame buffers */
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	/* Enable depth test  */
-	glEnable(GL_DEPTH_TEST);
-
-	/* Make the compiled shader program current */
-	glUseProgram(program[current_program]);
-
+	gl.enable(GL_DEPTH_TEST);
 
-	// Define our model transformation in a stack and 
-	// push the identity matrix onto the stack
-	stack<mat4> model;
-	model.push(mat4(1.0f));
+	/* Make the compiled shader program current, the unlit one until the lit one has been built */
+	program[1] = litProgram.getOr(program[0]);
+	gl.useProgram(program[current_program]);
 
-	// Define the normal matrix
-	mat3 normalmatrix;
 
 	// Projection matrix : 45 Field of View, 4:3 ratio, display range : 0.1 unit <-> 100 units
 	mat4 projection = perspective(radians(30.0f), aspect_ratio, 0.1f, 100.0f);
@@ -225,562 +392,161 @@ void display()
 	// Define the light position and transform by the view matrix
 	vec4 lightpos = view *  vec4(light_x, light_y, light_z, 1.0);
 
-	// Send our projection and view uniforms to the currently bound shader
-	// I do that here because they are the same for all objects
-	glUniform1ui(colourmodeID[current_program], colourmode);
-	glUniformMatrix4fv(viewID[current_program], 1, GL_FALSE, &view[0][0]);
-	glUniformMatrix4fv(projectionID[current_program], 1, GL_FALSE, &projection[0][0]);
-	glUniform4fv(lightposID[current_program], 1, &lightpos[0]);
-	glUniform1ui(attenuationmodeID[current_program], attenuationmode);
-
-	/* Draw a small sphere in the lightsource position to visually represent the light source */
-	model.push(model.top());
+	// Send the values that are the same for all objects to the shared per-frame uniform buffer
+	frameUniforms.view = view;
+	frameUniforms.projection = projection;
+	frameUniforms.lightpos = lightpos;
+	frameUniforms.colourmode = colourmode;
+	frameUniforms.attenuationmode = attenuationmode;
+	frameUniformBuffer.update(frameUniforms);
+
+	/* Time building the scene (the scene graph, culling and levels of detail) apart from submitting it, to
+	   tell the CPU cost of each from the GPU's */
+	Profiler &profiler = GLWrapper::profiler();
+	int sceneSection = profiler.getSection("scene", PROFILE_CPU);
+	int submitSection = profiler.getSection("submit", PROFILE_CPU);
+	int submitGPUSection = profiler.getSection("submit", PROFILE_GPU);
+	profiler.beginCPU(sceneSection);
+
+	/* Update the animated nodes of the scene graph. Setting a value that hasn't changed leaves the node
+	   clean, so in a frame where nothing moves no world matrices are recalculated. Rotating the box only
+	   recalculates the box and the parts attached to it, and opening the lid only the lid */
+	lightNode.setTranslation(vec3(light_x, light_y, light_z));
+	boxNode.setScale(vec3(model_scale, model_scale, model_scale));
+	GLfloat t = (GLfloat)alpha;
+	boxNode.setRotation(angleAxis(-radians(mix(last_angle_x, angle_x, t)), vec3(1, 0, 0)) *	//rotating in clockwise direction around x-axis
+						angleAxis(-radians(mix(last_angle_y, angle_y, t)), vec3(0, 1, 0)) *	//rotating in clockwise direction around y-axis
+						angleAxis(-radians(mix(last_angle_z, angle_z, t)), vec3(0, 0, 1)));	//rotating in clockwise direction around z-axis
+	lidHingeNode.setRotation(angleAxis(radians(mix(last_openLid, openLid, t)), vec3(1, 0, 0)));
+
+	/* Gather the world and normal matrices of the nodes. The scene graph keeps each node's world normal matrix
+	   in closed form, and the view only rotates and translates, so mat3(view) takes it to eye space without
+	   inverting anything. The light sends its normal matrix as a uniform, everything else as a per-instance
+	   attribute */
+	mat3 viewRotation = mat3(view);
+	for (int i = 0; i < NUM_DRAWN_NODES; i++)
+	{
+		drawnModels[i] = drawnNodes[i]->getWorldMatrix();
+		drawnNormals[i] = viewRotation * drawnNodes[i]->getWorldNormalMatrix();
+	}
+
+	for (int i = 0; i < NUM_CIGARS; i++)
+	{
+		cigarModels[i] = cigarNodes[i].getWorldMatrix();
+		cigarModels[NUM_CIGARS + i] = bandNodes[i].getWorldMatrix();
+		cigarNormals[i] = viewRotation * cigarNodes[i].getWorldNormalMatrix();
+		cigarNormals[NUM_CIGARS + i] = viewRotation * bandNodes[i].getWorldNormalMatrix();
+	}
+
+	/* Choose the light's and the hinges' levels of detail from their size on screen. The bounds are the same
+	   at every level */
+	MeshBuffer &meshes = GLWrapper::meshes();
+	lodSelector.setView(view, projection, viewportHeight);
+	aSphere.resetLODStats();
+	aCylinder.resetLODStats();
+	aCylinderCigar.resetLODStats();
+	GLuint lightLOD = aSphere.selectLOD(lodSelector.getSegments(meshes.getBounds(aSphere.mesh), drawnModels[DRAW_LIGHT]));
+	const MeshBounds &hingeBounds = meshes.getBounds(aCylinder.getMesh());
+	GLuint leftHingeLOD = aCylinder.selectLOD(lodSelector.getSegments(hingeBounds, drawnModels[DRAW_LEFT_HINGE]));
+	GLuint rightHingeLOD = aCylinder.selectLOD(lodSelector.getSegments(hingeBounds, drawnModels[DRAW_RIGHT_HINGE]));
+
+	/* Test everything against the view frustum, so that objects rotated or zoomed off screen aren't drawn */
+	MeshHandle drawnMeshes[NUM_DRAWN_NODES] =
+	{
+		aSphere.mesh, brownCube.mesh, brownCube.mesh, brownCube.mesh, brownCube.mesh, brownCube.mesh,
+		darkBrownCube.mesh, aCylinder.getMesh(), aCylinder.getMesh()
+	};
+	culler.clear();
+	for (int i = 0; i < NUM_DRAWN_NODES; i++)
+	{
+		culler.add(meshes.getBounds(drawnMeshes[i]), drawnModels[i]);
+	}
+	for (int i = 0; i < NUM_CIGARS * 2; i++)
+	{
+		culler.add(meshes.getBounds(aCylinderCigar.getMesh()), cigarModels[i]);
+	}
+	culler.cull(projection * view);
+
+	/* Only solid sides hide anything, so there is no occlusion culling when drawing lines or points */
+	bool occlusionCulling = drawmode == 0;
+	if (occlusionCulling)
+	{
+		occlusion.begin(projection * view);
+		for (int i = DRAW_BASE; i <= DRAW_LID; i++)
+		{
+			if (!culler.isVisible(i)) continue;
+			const MeshBounds &bounds = meshes.getBounds(drawnMeshes[i]);
+			occlusion.addOccluderBox(bounds.centre, bounds.extents, drawnModels[i]);
+		}
+		occlusion.buildHiZ();
+	}
+
+	profiler.endCPU(sceneSection);
+	profiler.beginCPU(submitSection);
+	profiler.beginGPU(submitGPUSection);
+
+	/* Draw a small sphere in the lightsource position to visually represent the light source, with emit mode on */
+	if (culler.isVisible(DRAW_LIGHT))
 	{
-		model.top() = translate(model.top(), vec3(light_x, light_y, light_z));
-		model.top() = scale(model.top(), vec3(0.05f, 0.05f, 0.05f));// Recalculate the normal matrix and send to the vertex shader
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our lightposition sphere  with emit mode on*/
 		emitmode = 1;
-		glUniform1ui(emitmodeID[current_program], emitmode);
-		aSphere.drawSphere(drawmode);
+		setModelUniforms(DRAW_LIGHT);
+		aSphere.drawSphere(drawmode, lightLOD);
 		emitmode = 0;
-		glUniform1ui(emitmodeID[current_program], emitmode);
-	}
-	model.pop();
-
-	// Define the global model transformations (rotate and scale). Note, we're not modifying the light source position
-	model.top() = scale(model.top(), vec3(model_scale, model_scale, model_scale));//scale equally in all axis
-	model.top() = rotate(model.top(), -radians(angle_x), glm::vec3(1, 0, 0)); //rotating in clockwise direction around x-axis
-	model.top() = rotate(model.top(), -radians(angle_y), glm::vec3(0, 1, 0)); //rotating in clockwise direction around y-axis
-	model.top() = rotate(model.top(), -radians(angle_z), glm::vec3(0, 0, 1)); //rotating in clockwise direction around z-axis
-
-	// This block of code draws the base of the cigar box
-	model.push(model.top());
-	{
-		// Define the model transformations for the cube
-		model.top() = translate(model.top(), vec3(0, -0.5f, 0));
-		model.top() = scale(model.top(), vec3(3, 0.2, 3));
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		brownCube.drawCube(drawmode);
-	}
-	model.pop();
-
-	// This block of code draws the left of the cigar box
-	model.push(model.top());
-	{
-		// Define the model transformations for the cube
-		model.top() = translate(model.top(), vec3(-0.75f, -0.3f, 0));
-		model.top() = scale(model.top(), vec3(0.2, 1, 3));
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		brownCube.drawCube(drawmode);
-	}
-	model.pop();
-
-	// This block of code draws the right of the cigar box
-	model.push(model.top());
-	{
-		// Define the model transformations for the cube
-		model.top() = translate(model.top(), vec3(0.75f, -0.3f, 0));
-		model.top() = scale(model.top(), vec3(0.2, 1, 3));
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		brownCube.drawCube(drawmode);
-	}
-	model.pop();
-
-	// This block of code draws the back of the cigar box
-	model.push(model.top());
-	{
-		// Define the model transformations for the cube
-		model.top() = translate(model.top(), vec3(0, -0.3f, -0.7f));
-		model.top() = scale(model.top(), vec3(3, 1, 0.2));
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		brownCube.drawCube(drawmode);
-	}
-	model.pop();
-
-	// This block of code draws the front of the cigar box
-	model.push(model.top());
-	{
-		// Define the model transformations for the cube
-		model.top() = translate(model.top(), vec3(0, -0.3f, 0.7f));
-		model.top() = scale(model.top(), vec3(3, 1, 0.2));
-	
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		brownCube.drawCube(drawmode);
-	}
-	model.pop();
-
-	// This block of code draws the top of the cigar box
-	model.push(model.top());
-	{
-		// Define the model transformations for the cube
-		//model.top() = translate(model.top(), vec3(0, -0.05, -0.75));
-		//model.top() = rotate(model.top(), radians(openLid), vec3(1, 0, 0));
-		//model.top() = translate(model.top(), vec3(0, 0.05, 0.75));
-		model.top() = scale(model.top(), vec3(3.2, 0.2, 3));
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		
-		/* Draw our cube*/
-		darkBrownCube.drawCube(drawmode);
 	}
-	model.pop();
-
-	// This block of code draws cylinder that acts as the hinges of the cigar box on the left side
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(-0.75, -0.05, -0.75));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(0, 0, 1));
-		model.top() = scale(model.top(), vec3(0.1, 0.05, 0.1));
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinder.drawCylinder(drawmode);
-	}
-	model.pop();
-
-	// This block of code draws cylinder that acts as the hinges of the cigar box on the right side
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(0.75, -0.05, -0.75));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(0, 0, 1));
-		model.top() = scale(model.top(), vec3(0.1, 0.05, 0.1));
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinder.drawCylinder(drawmode);
-	}
-	model.pop();
-
-	//Cigar 1
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(0, -0.4, 0));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(1, 0, 0));
-		model.top() = scale(model.top(), vec3(0.05, 0.5, 0.05));
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinderCigar.drawCylinderCigar(drawmode);
-	}
-	model.pop();
-
-	//Cigar Band 1
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(0, -0.4, 0.15));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(1, 0, 0));
-		model.top() = scale(model.top(), vec3(0.051, 0.05, 0.051));
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinderRed.drawCylinderRed(drawmode);
-	}
-	model.pop();
-
-	//Cigar 2
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(0.1, -0.4, 0));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(1, 0, 0));
-		model.top() = scale(model.top(), vec3(0.05, 0.5, 0.05));
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinderCigar.drawCylinderCigar(drawmode);
-	}
-	model.pop();
-
-	//Cigar Band 2
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(0.1, -0.4, 0.15));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(1, 0, 0));
-		model.top() = scale(model.top(), vec3(0.051, 0.05, 0.051));
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinderRed.drawCylinderRed(drawmode);
-	}
-	model.pop();
-
-	//Cigar 3
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(0.2, -0.4, 0));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(1, 0, 0));
-		model.top() = scale(model.top(), vec3(0.05, 0.5, 0.05));
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
 
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinderCigar.drawCylinderCigar(drawmode);
-	}
-	model.pop();
-	
-	//Cigar Band 3
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(0.2, -0.4, 0.15));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(1, 0, 0));
-		model.top() = scale(model.top(), vec3(0.051, 0.05, 0.051));
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinderRed.drawCylinderRed(drawmode);
-	}
-	model.pop();
-
-	//Cigar 4
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(-0.1, -0.4, 0));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(1, 0, 0));
-		model.top() = scale(model.top(), vec3(0.05, 0.5, 0.05));
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinderCigar.drawCylinderCigar(drawmode);
-	}
-	model.pop();
-
-	//Cigar Band 4
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(-0.1, -0.4, 0.15));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(1, 0, 0));
-		model.top() = scale(model.top(), vec3(0.051, 0.05, 0.051));
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinderRed.drawCylinderRed(drawmode);
-	}
-	model.pop();
-
-	//Cigar 5
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(-0.2, -0.4, 0));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(1, 0, 0));
-		model.top() = scale(model.top(), vec3(0.05, 0.5, 0.05));
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinderCigar.drawCylinderCigar(drawmode);
-	}
-	model.pop();
-
-	//Cigar Band 5
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(-0.2, -0.4, 0.15));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(1, 0, 0));
-		model.top() = scale(model.top(), vec3(0.051, 0.05, 0.051));
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinderRed.drawCylinderRed(drawmode);
-	}
-	model.pop();
-
-	//Cigar 6
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(0.05, -0.315, 0));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(1, 0, 0));
-		model.top() = scale(model.top(), vec3(0.05, 0.5, 0.05));
-		
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinderCigar.drawCylinderCigar(drawmode);
-	}
-	model.pop();
-
-	//Cigar Band 6
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(0.05, -0.315, 0.15));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(1, 0, 0));
-		model.top() = scale(model.top(), vec3(0.051, 0.05, 0.051));
-
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinderRed.drawCylinderRed(drawmode);
-	}
-	model.pop();
-
-	//Cigar 7
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(0.15, -0.315, 0));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(1, 0, 0));
-		model.top() = scale(model.top(), vec3(0.05, 0.5, 0.05));
-		
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinderCigar.drawCylinderCigar(drawmode);
-	}
-	model.pop();
-
-	//Cigar Band 7
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(0.15, -0.315, 0.15));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(1, 0, 0));
-		model.top() = scale(model.top(), vec3(0.051, 0.05, 0.051));
-
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinderRed.drawCylinderRed(drawmode);
-	}
-	model.pop();
-
-	//Cigar 8
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(-0.05, -0.315, 0));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(1, 0, 0));
-		model.top() = scale(model.top(), vec3(0.05, 0.5, 0.05));
-		
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinderCigar.drawCylinderCigar(drawmode);
-	}
-	model.pop();
-
-	//Cigar Band 8
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(-0.05, -0.315, 0.15));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(1, 0, 0));
-		model.top() = scale(model.top(), vec3(0.051, 0.05, 0.051));
-
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinderRed.drawCylinderRed(drawmode);
-	}
-	model.pop();
-
-	//Cigar 9
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(-0.15, -0.315, 0));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(1, 0, 0));
-		model.top() = scale(model.top(), vec3(0.05, 0.5, 0.05));
-		
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinderCigar.drawCylinderCigar(drawmode);
-	}
-	model.pop();
-
-	//Cigar Band 9
-	model.push(model.top());
-	{
-		// Define the model transformations for the cylinder
-		model.top() = translate(model.top(), vec3(-0.15, -0.315, 0.15));
-		model.top() = rotate(model.top(), radians(90.0f), vec3(1, 0, 0));
-		model.top() = scale(model.top(), vec3(0.051, 0.05, 0.051));
-
-
-		// Send the model uniform and normal matrix to the currently bound shader,
-		glUniformMatrix4fv(modelID[current_program], 1, GL_FALSE, &(model.top()[0][0]));
-
-		// Recalculate the normal matrix and send to the vertex shader
-		normalmatrix = transpose(inverse(mat3(view * model.top())));
-		glUniformMatrix3fv(normalmatrixID[current_program], 1, GL_FALSE, &normalmatrix[0][0]);
-
-		/* Draw our cube*/
-		aCylinderRed.drawCylinderRed(drawmode);
-	}
-	model.pop();
+	/* Everything else is collected into one batch and submitted together from the shared mesh buffer, so
+	   adding objects to the scene doesn't add draw calls. The box, lid and hinges use their node's world
+	   matrix as their only instance */
+	for (int i = DRAW_BASE; i <= DRAW_FRONT; i++)
+	{
+		if (culler.isVisible(i)) brownCube.batchCube(drawnModels[i], drawnNormals[i]);
+	}
+	if (culler.isVisible(DRAW_LID)) darkBrownCube.batchCube(drawnModels[DRAW_LID], drawnNormals[DRAW_LID]);
+	if (culler.isVisible(DRAW_LEFT_HINGE))
+		aCylinder.batchCylinder(drawnModels[DRAW_LEFT_HINGE], drawnNormals[DRAW_LEFT_HINGE], leftHingeLOD);
+	if (culler.isVisible(DRAW_RIGHT_HINGE))
+		aCylinder.batchCylinder(drawnModels[DRAW_RIGHT_HINGE], drawnNormals[DRAW_RIGHT_HINGE], rightHingeLOD);
+
+	// The cigars and bands share the same cylinder geometry so the visible ones at each level of detail are
+	// one command with a colour per instance
+	mat4 visibleModels[CYLINDER_MAX_LODS][NUM_CIGARS * 2];
+	mat3 visibleNormals[CYLINDER_MAX_LODS][NUM_CIGARS * 2];
+	vec4 visibleColours[CYLINDER_MAX_LODS][NUM_CIGARS * 2];
+	GLuint numVisible[CYLINDER_MAX_LODS] = { 0 };
+	const MeshBounds &cigarBounds = meshes.getBounds(aCylinderCigar.getMesh());
+	for (int i = 0; i < NUM_CIGARS * 2; i++)
+	{
+		if (!culler.isVisible(NUM_DRAWN_NODES + i)) continue;
+		if (occlusionCulling && !occlusion.isBoxVisible(cigarBounds.centre, cigarBounds.extents, cigarModels[i])) continue;
+		GLuint lod = aCylinderCigar.selectLOD(lodSelector.getSegments(cigarBounds, cigarModels[i]));
+		visibleModels[lod][numVisible[lod]] = cigarModels[i];
+		visibleNormals[lod][numVisible[lod]] = cigarNormals[i];
+		visibleColours[lod][numVisible[lod]] = cigarColours[i];
+		numVisible[lod]++;
+	}
+	for (GLuint lod = 0; lod < aCylinderCigar.getNumLODs(); lod++)
+	{
+		if (numVisible[lod] == 0) continue;	// Levels nobody can see aren't built
+		aCylinderCigar.batchCylinderInstanced(visibleModels[lod], visibleNormals[lod], visibleColours[lod], numVisible[lod], lod);
+	}
+
+	/* The batch reads its model and normal matrices from per-instance attributes. Points are drawn as the
+	   vertices of the batch's triangles */
+	DrawUniforms instancedDraw;
+	instancedDraw.model = mat4(1.0f);
+	instancedDraw.setNormalMatrix(mat3(1.0f));
+	instancedDraw.emitmode = 0;
+	instancedDraw.instanced = 1;
+	GLWrapper::constants().pushUniforms(DRAW_UNIFORMS_BINDING, &instancedDraw, sizeof(instancedDraw));
+
+	gl.pointSize(3.f);
+	if (drawmode == 1)
+		gl.polygonMode(GL_LINE);
+	else if (drawmode == 2)
+		gl.polygonMode(GL_POINT);
+	else
+		gl.polygonMode(GL_FILL);
+	GLWrapper::meshes().drawBatch();
 
 	///* Draw a small strip light */
 	//model.push(model.top());
@@ -803,8 +569,21 @@ void display()
 	//}
 	//model.pop();
 	
-	glDisableVertexAttribArray(0);
-	glUseProgram(0);
+	/* Leave no vertex array bound so that nothing outside display() can change the mesh buffer's shared VAOs */
+	gl.bindVertexArray(0);
+
+	profiler.endGPU(submitGPUSection);
+	profiler.endCPU(submitSection);
+}
+
+/* Advance the animation by one fixed timestep. This runs UPDATES_PER_SECOND times a second however fast
+   frames are drawn, so the box turns and the lid opens at the same speed at any frame rate */
+void update(double timestep)
+{
+	last_angle_x = angle_x;
+	last_angle_y = angle_y;
+	last_angle_z = angle_z;
+	last_openLid = openLid;
 
 	/* Modify our animation variables */
 	//Prevents the lid from opening more than logically allowed
@@ -827,9 +606,21 @@ void display()
 static void reshape(GLFWwindow* window, int w, int h)
 {
 	glViewport(0, 0, (GLsizei)w, (GLsizei)h);
+	viewportHeight = (GLfloat)h;
 	aspect_ratio = ((float)w / 640.f*4.f) / ((float)h / 480.f*3.f);
 }
 
+/* Print the instances and triangles drawn at each level of detail of a primitive in the last frame */
+static void printLODStats(const char *name, const LODStats &stats, GLuint numlods)
+{
+	cout << "  " << name << ":";
+	for (GLuint lod = 0; lod < numlods; lod++)
+	{
+		cout << " [" << lod << "] " << stats.draws[lod] << " drawn, " << stats.triangles[lod] << " triangles";
+	}
+	cout << endl;
+}
+
 /* change view angle, exit upon ESC */
 static void keyCallback(GLFWwindow* window, int key, int s, int action, int mods)
 {
@@ -876,6 +667,90 @@ static void keyCallback(GLFWwindow* window, int key, int s, int action, int mods
 	if (key == 'U') vz -= 1.f;
 	if (key == 'O') vz += 1.f;
 
+	/* Print how many state changes the state cache passed on to OpenGL and skipped in the last frame */
+	if (key == 'P' && action == GLFW_PRESS)
+	{
+		GLStateStats stats = GLWrapper::state().getFrameStats();
+		cout << "GL state calls issued: " << stats.issued << ", elided: " << stats.elided << endl;
+		cout << "Constant ring stalls: " << GLWrapper::constants().getStalls()
+			<< (GLWrapper::constants().isPersistent() ? " (persistent mapping)" : " (unsynchronised mapping)") << endl;
+		cout << "Batch: " << GLWrapper::meshes().getBatchCommands() << " commands, "
+			<< GLWrapper::meshes().getBatchInstances() << " instances"
+			<< (GLWrapper::meshes().isMultiDraw() ? " in one multi-draw" : " in an indirect draw each") << endl;
+		CullStats cullStats = culler.getStats();
+		cout << "Frustum culling: " << cullStats.drawn << " drawn, " << cullStats.culled << " culled of "
+			<< cullStats.tested << endl;
+		OcclusionStats occlusionStats = occlusion.getStats();
+		cout << "Occlusion culling: " << occlusionStats.occluded << " occluded of " << occlusionStats.tested
+			<< ", " << occlusionStats.occluderTriangles << " occluder triangles" << endl;
+		cout << "Levels of detail at " << lodSelector.getPixelError() << " pixel error:" << endl;
+		printLODStats("Sphere", aSphere.getLODStats(), aSphere.getNumLODs());
+		printLODStats("Hinges", aCylinder.getLODStats(), aCylinder.getNumLODs());
+		printLODStats("Cigars", aCylinderCigar.getLODStats(), aCylinderCigar.getNumLODs());
+		FrameTimeStats frameStats = GLWrapper::pacer().getStats();
+		cout << "Frame time over " << frameStats.frames << " frames: mean " << frameStats.mean << "ms, standard deviation "
+			<< frameStats.standardDeviation << "ms, min " << frameStats.minimum << "ms, max " << frameStats.maximum
+			<< "ms, " << frameStats.missed << " missed" << endl;
+		GLWrapper::profiler().report(cout);
+		LoopTimings loopTimings = glwrapper->getLoopTimings();
+		cout << "Last frame: " << loopTimings.updates << " updates in " << loopTimings.updateTime << "ms, rendered in "
+			<< loopTimings.renderTime << "ms" << endl;
+		ProgramCache &programCache = GLWrapper::programCache();
+		cout << "Program cache: " << programCache.getHits() << " loaded, " << programCache.getMisses() << " built, "
+			<< programCache.getRejected() << " rejected by the driver" << endl;
+		BufferArenaStats vertexStats = GLWrapper::meshes().getVertexStats();
+		BufferArenaStats indexStats = GLWrapper::meshes().getIndexStats();
+		cout << "Mesh vertices: " << vertexStats.used << " bytes used, " << vertexStats.peak << " peak, "
+			<< vertexStats.capacity << " capacity, fragmentation " << vertexStats.fragmentation << endl;
+		cout << "Mesh indices: " << indexStats.used << " bytes used, " << indexStats.peak << " peak, "
+			<< indexStats.capacity << " capacity, fragmentation " << indexStats.fragmentation << endl;
+	}
+
+	/* Halve or double the pixel error allowed in the outlines of the sphere and cylinders */
+	if (key == '[' && action == GLFW_PRESS) lodSelector.setPixelError(lodSelector.getPixelError() * 2.f);
+	if (key == ']' && action == GLFW_PRESS) lodSelector.setPixelError(lodSelector.getPixelError() * 0.5f);
+
+	/* Change how frames are paced. The frame time statistics restart so they only cover the new setting */
+	if (key == 'V' && action == GLFW_PRESS)
+	{
+		// Cycle through the requested mode, adaptive falls back to on when the driver doesn't support it
+		static int requested = SWAP_VSYNC;
+		const char *names[] = { "off", "on", "adaptive" };
+		FramePacer &pacer = GLWrapper::pacer();
+		requested = (requested + 1) % 3;
+		pacer.setSwapMode((SwapMode)requested);
+		pacer.resetStats();
+		cout << "Vertical sync " << names[pacer.getSwapMode()] << endl;
+	}
+	if (key == 'M' && action == GLFW_PRESS)
+	{
+		const double limits[] = { 0, 30, 60, 120 };
+		FramePacer &pacer = GLWrapper::pacer();
+		int next = 0;
+		while (next < 3 && limits[next] != pacer.getTargetFPS()) next++;
+		next = (next + 1) % 4;
+		pacer.setTargetFPS(limits[next]);
+		pacer.resetStats();
+		cout << "Frame rate limit " << limits[next] << " FPS" << endl;
+	}
+
+	/* Start and stop recording every frame to numbered PNG files in the working directory */
+	if (key == GLFW_KEY_F12 && action == GLFW_PRESS)
+	{
+		FrameCapture &capture = GLWrapper::capture();
+		if (capture.isCapturing())
+		{
+			capture.stop();
+			cout << "Capture stopped, " << capture.getFramesCaptured() << " frames captured, "
+				<< capture.getFramesSkipped() << " skipped" << endl;
+		}
+		else
+		{
+			capture.start("assignment1_");
+			cout << "Capturing frames" << endl;
+		}
+	}
+
 	/* Turn attenuation on and off */
 	if (key == '.' && action != GLFW_PRESS)
 	{
@@ -885,10 +760,27 @@ static void keyCallback(GLFWwindow* window, int key, int s, int action, int mods
 
 
 
-/* Entry point of program */
+/* Entry point of program. The benchmark build has its own, see bench_assignment1.cpp */
+#ifndef ASSIGNMENT1_BENCHMARK
 int main(int argc, char* argv[])
 {
-	GLWrapper *glw = new GLWrapper(1024, 768, "Assignment 1: Cigar Box");;
+	/* --headless draws offscreen without showing the window, for a number of frames given by --frames
+	   (600 by default), then prints the profile. --capture prefix records every frame as PNG files named
+	   prefix plus the frame number */
+	bool headless = false;
+	unsigned int frames = 0;
+	const char *capturePrefix = NULL;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--headless") == 0) headless = true;
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) frames = (unsigned int)atoi(argv[++i]);
+		if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) capturePrefix = argv[++i];
+	}
+	if (headless && frames == 0) frames = 600;
+
+	GLWrapper *glw = new GLWrapper(1024, 768, "Assignment 1: Cigar Box", headless);
+	glwrapper = glw;
+	glw->setMaxFrames(frames);
 
 	if (!ogl_LoadFunctions())
 	{
@@ -897,13 +789,28 @@ int main(int argc, char* argv[])
 	}
 
 	glw->setRenderer(display);
+	glw->setUpdate(update, UPDATES_PER_SECOND);
 	glw->setKeyCallback(keyCallback);
 	glw->setReshapeCallback(reshape);
 
-	init(glw);
+	/* The profile summary is written here when the window is closed */
+	GLWrapper::profiler().setExportPath("assignment1_profile.csv");
+	{
+		ProfileScope scope(GLWrapper::profiler(), "init");
+		init(glw);
+	}
+
+	if (capturePrefix) GLWrapper::capture().start(capturePrefix);
 
 	glw->eventLoop();
+	if (headless) GLWrapper::profiler().report(cout);
+	if (capturePrefix)
+	{
+		cout << GLWrapper::capture().getFramesCaptured() << " frames captured, "
+			<< GLWrapper::capture().getFramesSkipped() << " skipped" << endl;
+	}
 
 	delete(glw);
 	return 0;
-}
\ No newline at end of file
+}
+#endif
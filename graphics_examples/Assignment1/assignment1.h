@@ -0,0 +1,31 @@
+/* assignment1.h
+ The parts of the cigar box scene that another program can drive. bench_assignment1 builds
+ assignment1.cpp with ASSIGNMENT1_BENCHMARK defined, which leaves out its main(), and sets these
+ from a script each frame instead of the keyboard.
+*/
+
+#pragma once
+
+#include "wrapper_glfw.h"
+#include "frameuniforms.h"
+
+/* Set up the shaders, meshes and scene graph. Needs a current context */
+void init(GLWrapper *glw);
+
+/* Draw a frame, alpha of the way from the last update's values to the current ones */
+void display(double alpha);
+
+/* Advance the key-driven animation by one fixed timestep */
+void update(double timestep);
+
+/* Box rotation in degrees, lid angle (0 closed, -90 fully open) and their values before the last update */
+extern GLfloat angle_x, angle_y, angle_z, openLid;
+extern GLfloat last_angle_x, last_angle_y, last_angle_z, last_openLid;
+
+/* Scale of the box, camera rotation in degrees and light position */
+extern GLfloat model_scale, vx, vy, vz;
+extern GLfloat light_x, light_y, light_z;
+
+extern GLuint drawmode;
+extern FrameUniformBuffer frameUniformBuffer;
+extern GLWrapper *glwrapper;
@@ -0,0 +1,104 @@
+/*
+ occlusiontest.cpp
+ Checks the software occlusion culler against a wall in front of the camera: a box hidden behind
+ it, a box in front of it, a box poking out past its edge and a box crossing the near plane. Each
+ case is run at the default depth buffer size and at sizes that aren't powers of two, with every
+ instruction set the CPU supports, and each hierarchical-Z level is checked against the full
+ resolution depth buffer it was built from.
+ No window or OpenGL context is needed. Returns 0 if every check passes.
+*/
+
+#include <iostream>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include "glm/gtc/matrix_transform.hpp"
+
+#include "occlusioncull.h"
+
+using namespace std;
+using namespace glm;
+
+const int testSizes[][2] = { { OCCLUSION_WIDTH, OCCLUSION_HEIGHT }, { 12, 10 }, { 100, 75 } };
+
+int failures = 0;
+
+void check(bool passed, const char *name, int width, int height, TransformISA isa)
+{
+	if (passed) return;
+	cout << "FAILED: " << name << " at " << width << "x" << height << " with " << getTransformISAName(isa) << endl;
+	failures++;
+}
+
+/* Every texel of every level should be the farthest of the full resolution pixels it covers */
+bool checkHiZ(const OcclusionCuller &culler)
+{
+	const float *depth = culler.getDepth(0);
+	int width = culler.getWidth(), height = culler.getHeight();
+	for (int level = 1; (1 << (level - 1)) < std::max(width, height); level++)
+	{
+		const float *hiz = culler.getDepth(level);
+		int w = (width + (1 << level) - 1) >> level;
+		int h = (height + (1 << level) - 1) >> level;
+		for (int y = 0; y < h; y++)
+		{
+			for (int x = 0; x < w; x++)
+			{
+				float farthest = 0.f;
+				for (int py = y << level; py < std::min(height, (y + 1) << level); py++)
+				{
+					for (int px = x << level; px < std::min(width, (x + 1) << level); px++)
+					{
+						farthest = std::max(farthest, depth[py * width + px]);
+					}
+				}
+				if (hiz[y * w + x] != farthest) return false;
+			}
+		}
+	}
+	return true;
+}
+
+void runTests(int width, int height, TransformISA isa)
+{
+	/* The camera looks down -z from z = 4, as in the cigar box scene, at a thin wall 3 units away */
+	mat4 projection = perspective(radians(30.0f), 4.f / 3.f, 0.1f, 100.0f);
+	mat4 view = lookAt(vec3(0, 0, 4), vec3(0, 0, 0), vec3(0, 1, 0));
+	mat4 wall = translate(mat4(1.f), vec3(0, 0, 1)) * scale(mat4(1.f), vec3(0.5f, 0.5f, 0.02f));
+
+	OcclusionCuller culler(width, height);
+	culler.begin(projection * view, isa);
+	culler.addOccluderBox(vec3(0.f), vec3(1.f), wall);
+
+	/* A tilted second occluder so the depth buffer isn't flat, for the hierarchical-Z check */
+	culler.addOccluderBox(vec3(0.f), vec3(1.f), translate(mat4(1.f), vec3(-0.6f, 0.4f, 0)) *
+		rotate(mat4(1.f), radians(50.f), vec3(0, 1, 0)) * scale(mat4(1.f), vec3(0.4f, 0.3f, 0.02f)));
+	culler.buildHiZ();
+
+	vec3 centre(0.f), extents(0.3f);
+	check(!culler.isBoxVisible(centre, extents, translate(mat4(1.f), vec3(0, 0, -1))), "box behind the wall is occluded",
+		width, height, isa);
+	check(culler.isBoxVisible(centre, extents, translate(mat4(1.f), vec3(0, 0, 2))), "box in front of the wall is visible",
+		width, height, isa);
+	check(culler.isBoxVisible(centre, extents, translate(mat4(1.f), vec3(1, 0, -1))), "box past the wall's edge is visible",
+		width, height, isa);
+	check(culler.isBoxVisible(centre, extents, translate(mat4(1.f), vec3(0, 0, 3.95f))), "box crossing the near plane is visible",
+		width, height, isa);
+	check(checkHiZ(culler), "hierarchical-Z levels match the depth buffer", width, height, isa);
+	check(culler.getStats().occluded == 1, "only one box occluded", width, height, isa);
+}
+
+int main(int argc, char* argv[])
+{
+	TransformISA best = getBestTransformISA();
+	for (int isa = TRANSFORM_SCALAR; isa <= best; isa++)
+	{
+		for (size_t i = 0; i < sizeof(testSizes) / sizeof(testSizes[0]); i++)
+		{
+			runTests(testSizes[i][0], testSizes[i][1], (TransformISA)isa);
+		}
+	}
+
+	if (failures == 0) cout << "All occlusion culling tests passed" << endl;
+	return failures == 0 ? 0 : 1;
+}
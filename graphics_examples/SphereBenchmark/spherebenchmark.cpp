@@ -0,0 +1,154 @@
+/*
+ spherebenchmark.cpp
+ Measures the CPU cost of submitting a sphere as a single indexed triangle list (the current
+ Sphere::drawSphere) against the original submission of one draw per latitude band plus one for
+ each pole, over a range of sphere resolutions.
+ For each numlats value it prints the number of draw calls per sphere and the CPU time spent
+ submitting each sphere, which is the cost that grows with resolution in the per-band version.
+*/
+
+/* Link to static libraries, could define these as linker inputs in the project settings instead
+if you prefer */
+#ifdef _DEBUG
+#pragma comment(lib, "glfw3D.lib")
+#pragma comment(lib, "glloadD.lib")
+#else
+#pragma comment(lib, "glfw3.lib")
+#pragma comment(lib, "glload.lib")
+#endif
+#pragma comment(lib, "opengl32.lib")
+
+#include "wrapper_glfw.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+
+#include "sphere.h"
+
+using namespace std;
+
+const int NUM_FRAMES = 100;			// Frames timed for each resolution
+const int SPHERES_PER_FRAME = 100;	// Spheres submitted in each frame
+
+const GLuint resolutions[] = { 10, 20, 40, 80, 160, 320 };
+
+/* Minimal shaders, the benchmark measures submission so the shading cost is kept negligible */
+const char *vertexShaderSource =
+	"#version 400\n"
+	"layout(location = 0) in vec3 position;\n"
+	"void main() { gl_Position = vec4(position * 0.01, 1.0); }\n";
+
+const char *fragmentShaderSource =
+	"#version 400\n"
+	"out vec4 outputColor;\n"
+	"void main() { outputColor = vec4(1.0); }\n";
+
+/* Submit the sphere the way drawSphere did before it became a single draw: the north pole, each
+   latitude band and the south pole as separate draws. Each of those is a contiguous range of the
+   triangle list so the same index buffer is used and only the number of draw calls differs */
+GLuint drawSpherePerBand(Sphere &sphere)
+{
+	MeshRange part = GLWrapper::meshes().getRange(sphere.mesh);
+	GLuint capindices = sphere.numlongs * 3;
+	GLuint bandindices = sphere.numlongs * 6;
+	GLuint drawcalls = 0;
+
+	part.indexCount = capindices;
+	GLWrapper::meshes().drawRange(part, GL_TRIANGLES);
+	part.firstIndex += capindices;
+	drawcalls++;
+
+	part.indexCount = bandindices;
+	for (int i = 0; i < sphere.numlats - 2; i++)
+	{
+		GLWrapper::meshes().drawRange(part, GL_TRIANGLES);
+		part.firstIndex += bandindices;
+		drawcalls++;
+	}
+
+	part.indexCount = capindices;
+	GLWrapper::meshes().drawRange(part, GL_TRIANGLES);
+	drawcalls++;
+
+	return drawcalls;
+}
+
+/* Time NUM_FRAMES frames of SPHERES_PER_FRAME submissions and return the average CPU submit time per
+   sphere in microseconds. glFinish is outside the timed region so only the submission is measured */
+template <typename Submit>
+double timeSubmission(GLWrapper *glw, Submit submit)
+{
+	double total = 0;
+	for (int frame = 0; frame < NUM_FRAMES; frame++)
+	{
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int i = 0; i < SPHERES_PER_FRAME; i++)
+		{
+			submit();
+		}
+		chrono::steady_clock::time_point end = chrono::steady_clock::now();
+		total += chrono::duration<double, micro>(end - start).count();
+
+		glFinish();
+		glfwSwapBuffers(glw->getWindow());
+		glfwPollEvents();
+	}
+	return total / (NUM_FRAMES * SPHERES_PER_FRAME);
+}
+
+int main(int argc, char* argv[])
+{
+	GLWrapper *glw = new GLWrapper(640, 480, "Sphere submission benchmark");
+
+	if (!ogl_LoadFunctions())
+	{
+		fprintf(stderr, "ogl_LoadFunctions() failed. Exiting\n");
+		return 0;
+	}
+
+	glw->DisplayVersion();
+
+	GLuint program;
+	try
+	{
+		program = glw->BuildShaderProgram(vertexShaderSource, fragmentShaderSource);
+	}
+	catch (exception &e)
+	{
+		cout << "Caught exception: " << e.what() << endl;
+		return 0;
+	}
+
+	GLWrapper::state().useProgram(program);
+
+	/* Don't wait for vsync, it would hide the submission cost */
+	GLWrapper::pacer().setSwapMode(SWAP_IMMEDIATE);
+
+	cout << endl;
+	cout << setw(8) << "numlats" << setw(12) << "triangles"
+		<< setw(14) << "draws(band)" << setw(14) << "draws(one)"
+		<< setw(16) << "us/sphere(band)" << setw(16) << "us/sphere(one)" << endl;
+
+	for (GLuint numlats : resolutions)
+	{
+		Sphere sphere;
+		sphere.makeSphere(numlats, numlats);
+
+		GLuint banddraws = 0;
+		double bandtime = timeSubmission(glw, [&]() { banddraws = drawSpherePerBand(sphere); });
+		double singletime = timeSubmission(glw, [&]() { sphere.drawSphere(0); });
+
+		cout << setw(8) << numlats << setw(12) << sphere.numindices / 3
+			<< setw(14) << banddraws << setw(14) << 1
+			<< setw(16) << fixed << setprecision(2) << bandtime << setw(16) << singletime << endl;
+
+		/* Give the sphere's space in the shared mesh buffer back for the next resolution */
+		GLWrapper::meshes().remove(sphere.mesh);
+	}
+
+	glDeleteProgram(program);
+	delete(glw);
+	return 0;
+}
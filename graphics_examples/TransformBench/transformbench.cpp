@@ -0,0 +1,129 @@
+/*
+ transformbench.cpp
+ Measures the throughput of computing the model-view, model-view-projection and normal matrices
+ for 1k, 100k and 1M objects, one object at a time through glm (as display() used to do) against
+ the structure-of-arrays batch kernel with each instruction set the CPU supports.
+ No window or OpenGL context is needed.
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+
+#include <glm/glm.hpp>
+#include "glm/gtc/matrix_transform.hpp"
+
+#include "batchtransform.h"
+
+using namespace std;
+using namespace glm;
+
+const size_t objectCounts[] = { 1000, 100000, 1000000 };
+const size_t TRANSFORMS_PER_TEST = 10000000;	// Each test repeats until about this many objects are transformed
+
+/* Random translate/rotate/scale model matrix like the ones in the cigar box scene */
+mat4 randomModel()
+{
+	float r[7];
+	for (int i = 0; i < 7; i++) r[i] = (float)rand() / RAND_MAX;
+
+	mat4 model = translate(mat4(1.f), vec3(r[0] - 0.5f, r[1] - 0.5f, r[2] - 0.5f) * 10.f);
+	model = rotate(model, r[3] * 6.28f, normalize(vec3(r[4] + 0.1f, r[5], r[6])));
+	model = scale(model, vec3(0.1f + r[4], 0.1f + r[5], 0.1f + r[6]));
+	return model;
+}
+
+/* Run a test enough times to transform about TRANSFORMS_PER_TEST objects and return millions of
+   objects per second */
+template <typename Test>
+double throughput(size_t count, Test test)
+{
+	size_t repeats = TRANSFORMS_PER_TEST / count;
+	if (repeats < 1) repeats = 1;
+
+	test();		// Warm up the caches and page in the outputs
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (size_t i = 0; i < repeats; i++)
+	{
+		test();
+	}
+	chrono::steady_clock::time_point end = chrono::steady_clock::now();
+	double seconds = chrono::duration<double>(end - start).count();
+	return (double)(count * repeats) / seconds / 1e6;
+}
+
+int main(int argc, char* argv[])
+{
+	mat4 projection = perspective(radians(30.0f), 1.3333f, 0.1f, 100.0f);
+	mat4 view = lookAt(vec3(0, 0, 4), vec3(0, 0, 0), vec3(0, 1, 0));
+
+	TransformISA best = getBestTransformISA();
+	cout << "Best supported instruction set: " << getTransformISAName(best) << endl << endl;
+
+	cout << setw(10) << "objects" << setw(12) << "method" << setw(16) << "Mobjects/s"
+		<< setw(10) << "speedup" << setw(14) << "max error" << endl;
+
+	for (size_t count : objectCounts)
+	{
+		/* The same models in both layouts */
+		vector<mat4> models(count);
+		Matrix4Batch batchModels(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			models[i] = randomModel();
+			batchModels.set(i, models[i]);
+		}
+
+		/* Per-object glm path */
+		vector<mat4> mv(count), mvp(count);
+		vector<mat3> normals(count);
+		double glmRate = throughput(count, [&]()
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				mv[i] = view * models[i];
+				mvp[i] = projection * mv[i];
+				normals[i] = transpose(inverse(mat3(mv[i])));
+			}
+		});
+		cout << setw(10) << count << setw(12) << "glm" << setw(16) << fixed << setprecision(1) << glmRate
+			<< setw(10) << setprecision(2) << 1.0 << endl;
+
+		/* Batch kernel with each supported instruction set */
+		Matrix4Batch batchMV, batchMVP;
+		Matrix3Batch batchNormals;
+		for (int isa = TRANSFORM_SCALAR; isa <= best; isa++)
+		{
+			double rate = throughput(count, [&]()
+			{
+				batchTransform(view, projection, batchModels, &batchMV, &batchMVP, &batchNormals, (TransformISA)isa);
+			});
+
+			/* Check the results against glm */
+			float maxError = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				mat4 a = batchMVP.get(i);
+				mat3 n = batchNormals.get(i);
+				for (int c = 0; c < 3; c++)
+				{
+					for (int r = 0; r < 3; r++)
+					{
+						maxError = glm::max(maxError, abs(n[c][r] - normals[i][c][r]));
+						maxError = glm::max(maxError, abs(a[c][r] - mvp[i][c][r]));
+					}
+				}
+			}
+
+			cout << setw(10) << count << setw(12) << getTransformISAName((TransformISA)isa)
+				<< setw(16) << setprecision(1) << rate << setw(10) << setprecision(2) << rate / glmRate
+				<< setw(14) << scientific << setprecision(2) << maxError << fixed << endl;
+		}
+		cout << endl;
+	}
+
+	return 0;
+}
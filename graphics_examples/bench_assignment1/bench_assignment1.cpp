@@ -0,0 +1,236 @@
+/*
+ bench_assignment1.cpp
+ Repeatable performance numbers for the Assignment1 cigar box scene. Instead of the keyboard, a
+ fixed script drives the scene: the camera orbits the box, the light circles it, the lid opens
+ and closes and the box grows and shrinks. The script is a function of the frame number only,
+ so every run draws exactly the same frames whatever the frame rate.
+
+ After a number of warmup frames it measures a number of frames and writes the results as JSON,
+ to standard output or to a file:
+	frames per second and the mean, 50th, 95th, 99th percentile and longest frame times
+	draw calls, GL state changes issued and elided by the state cache, and bytes uploaded per frame
+	the event loop's profile sections
+
+ Usage: bench_assignment1 [--frames N] [--warmup N] [--headless] [--output file.json]
+ The swap interval is immediate and the frame rate unlimited so the numbers measure the frame,
+ not the display. --headless draws into an offscreen framebuffer, see wrapper_glfw.h.
+*/
+
+/* Link to static libraries, could define these as linker inputs in the project settings instead
+if you prefer */
+#ifdef _DEBUG
+#pragma comment(lib, "glfw3D.lib")
+#pragma comment(lib, "glloadD.lib")
+#else
+#pragma comment(lib, "glfw3.lib")
+#pragma comment(lib, "glload.lib")
+#endif
+#pragma comment(lib, "opengl32.lib")
+
+#include "wrapper_glfw.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "meshbuffer.h"
+#include "../Assignment1/assignment1.h"
+
+using namespace std;
+
+const double SCRIPT_RATE = 60;		// Frames per second of script time, however fast the frames are really drawn
+const double PI = 3.141592653589793;
+
+/* Periods of the scripted movements in seconds of script time */
+const double ORBIT_PERIOD = 20;
+const double LIGHT_PERIOD = 8;
+const double LID_PERIOD = 6;
+const double SCALE_PERIOD = 10;
+
+unsigned int warmupFrames = 60;
+unsigned int measuredFrames = 1000;
+unsigned int frame = 0;
+
+/* Running totals read at the start of each frame, so a frame's counts are the difference from the next */
+struct Counters
+{
+	chrono::steady_clock::time_point time;
+	unsigned long long drawCalls;
+	unsigned long long bytesUploaded;
+};
+
+Counters previous;
+vector<double> frameTimes;		// Milliseconds
+unsigned long long drawCalls, bytesUploaded, stateIssued, stateElided;
+
+static Counters readCounters()
+{
+	Counters counters;
+	counters.time = chrono::steady_clock::now();
+	counters.drawCalls = GLWrapper::meshes().getDrawCalls();
+	counters.bytesUploaded = GLWrapper::meshes().getBytesUploaded() + GLWrapper::constants().getBytesPushed()
+		+ frameUniformBuffer.getBytesUploaded();
+	return counters;
+}
+
+/* Put the scene where the script has it at time t. The previous values are set the same so nothing is
+   interpolated */
+static void applyScript(double t)
+{
+	vx = (GLfloat)(15 * sin(2 * PI * t / ORBIT_PERIOD * 2));
+	vy = (GLfloat)(360 * t / ORBIT_PERIOD);
+	vz = 0;
+
+	light_x = (GLfloat)(0.9 * cos(2 * PI * t / LIGHT_PERIOD));
+	light_y = (GLfloat)(0.3 + 0.2 * sin(2 * PI * t / LIGHT_PERIOD * 3));
+	light_z = (GLfloat)(0.9 * sin(2 * PI * t / LIGHT_PERIOD));
+
+	openLid = (GLfloat)(-45 * (1 - cos(2 * PI * t / LID_PERIOD)));
+	model_scale = (GLfloat)(1 + 0.25 * sin(2 * PI * t / SCALE_PERIOD));
+	angle_x = angle_y = angle_z = 0;
+
+	last_angle_x = angle_x;
+	last_angle_y = angle_y;
+	last_angle_z = angle_z;
+	last_openLid = openLid;
+}
+
+/* Render callback. The frame before the first measured one is drawn too, to start the measurement */
+static void benchFrame()
+{
+	Counters now = readCounters();
+	if (frame > warmupFrames)
+	{
+		frameTimes.push_back(chrono::duration<double, milli>(now.time - previous.time).count());
+		drawCalls += now.drawCalls - previous.drawCalls;
+		bytesUploaded += now.bytesUploaded - previous.bytesUploaded;
+	}
+	previous = now;
+
+	applyScript(frame / SCRIPT_RATE);
+	display(1.0);
+
+	if (frame >= warmupFrames && frame < warmupFrames + measuredFrames)
+	{
+		GLStateStats stats = GLWrapper::state().getCurrentStats();
+		stateIssued += stats.issued;
+		stateElided += stats.elided;
+	}
+	frame++;
+}
+
+/* Nearest rank percentile of sorted samples */
+static double percentile(const vector<double> &sorted, unsigned int p)
+{
+	if (sorted.empty()) return 0;
+	return sorted[(sorted.size() * p + 99) / 100 - 1];
+}
+
+static void writeJSON(ostream &out, bool headless, int width, int height)
+{
+	vector<double> sorted = frameTimes;
+	sort(sorted.begin(), sorted.end());
+
+	double total = 0;
+	for (size_t i = 0; i < sorted.size(); i++)
+	{
+		total += sorted[i];
+	}
+	double n = sorted.empty() ? 1 : (double)sorted.size();
+
+	out << fixed << setprecision(4);
+	out << "{" << endl;
+	out << "\t\"frames\": " << frameTimes.size() << "," << endl;
+	out << "\t\"warmup_frames\": " << warmupFrames << "," << endl;
+	out << "\t\"headless\": " << (headless ? "true" : "false") << "," << endl;
+	out << "\t\"width\": " << width << "," << endl;
+	out << "\t\"height\": " << height << "," << endl;
+	out << "\t\"fps\": " << (total > 0 ? sorted.size() * 1000.0 / total : 0) << "," << endl;
+	out << "\t\"frame_ms\": { \"mean\": " << total / n << ", \"p50\": " << percentile(sorted, 50)
+		<< ", \"p95\": " << percentile(sorted, 95) << ", \"p99\": " << percentile(sorted, 99)
+		<< ", \"max\": " << (sorted.empty() ? 0 : sorted.back()) << " }," << endl;
+	out << "\t\"draw_calls_per_frame\": " << drawCalls / n << "," << endl;
+	out << "\t\"state_changes_per_frame\": { \"issued\": " << stateIssued / n << ", \"elided\": " << stateElided / n << " }," << endl;
+	out << "\t\"bytes_uploaded_per_frame\": " << bytesUploaded / n << "," << endl;
+	out << "\t\"bytes_uploaded\": " << bytesUploaded << "," << endl;
+
+	/* The profile histories hold the last PROFILE_HISTORY frames, warmup included if there are fewer measured */
+	const Profiler &profiler = GLWrapper::profiler();
+	out << "\t\"sections\": [" << endl;
+	for (int i = 0; i < profiler.getNumSections(); i++)
+	{
+		ProfileStats stats = profiler.getStats(i);
+		out << "\t\t{ \"name\": \"" << profiler.getSectionName(i) << "\", \"type\": \""
+			<< (profiler.getSectionType(i) == PROFILE_GPU ? "gpu" : "cpu") << "\", \"samples\": " << stats.samples
+			<< ", \"mean\": " << stats.mean << ", \"p50\": " << stats.p50 << ", \"p95\": " << stats.p95
+			<< ", \"p99\": " << stats.p99 << ", \"max\": " << stats.maximum << " }"
+			<< (i + 1 < profiler.getNumSections() ? "," : "") << endl;
+	}
+	out << "\t]," << endl;
+	out << "\t\"dropped_gpu_samples\": " << profiler.getDroppedQueries() << endl;
+	out << "}" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+	bool headless = false;
+	const char *output = NULL;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--headless") == 0) headless = true;
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) measuredFrames = (unsigned int)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) warmupFrames = (unsigned int)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) output = argv[++i];
+		else
+		{
+			cerr << "Usage: " << argv[0] << " [--frames N] [--warmup N] [--headless] [--output file.json]" << endl;
+			return 1;
+		}
+	}
+	if (measuredFrames == 0) measuredFrames = 1;
+
+	GLWrapper *glw = new GLWrapper(1024, 768, "Assignment 1 benchmark", headless);
+	glwrapper = glw;
+
+	if (!ogl_LoadFunctions())
+	{
+		fprintf(stderr, "ogl_LoadFunctions() failed. Exiting\n");
+		return 1;
+	}
+
+	/* No reshape or key callbacks, the window stays the same size and the script is the only input */
+	glw->setRenderer(benchFrame);
+	glw->setMaxFrames(warmupFrames + measuredFrames + 1);
+	init(glw);
+
+	/* Every measured frame should use the same programs, so wait for any still building in the background */
+	GLWrapper::shaderBuilder().waitAll();
+
+	GLWrapper::pacer().setSwapMode(SWAP_IMMEDIATE);
+	glw->setFPS(0);
+	frameTimes.reserve(measuredFrames);
+
+	glw->eventLoop();
+
+	if (output)
+	{
+		ofstream file(output);
+		if (!file.is_open())
+		{
+			cerr << "Couldn't write " << output << endl;
+			return 1;
+		}
+		writeJSON(file, headless, glw->getWidth(), glw->getHeight());
+	}
+	else
+	{
+		writeJSON(cout, headless, glw->getWidth(), glw->getHeight());
+	}
+
+	delete(glw);
+	return 0;
+}
@@ -13,8 +13,24 @@ int  shininess = 8;
 in vec3 fnormal, flightdir, fposition;
 in vec4 fdiffusecolour, fambientcolour;
 
-uniform uint attenuationmode;
-uniform uint emitmode;
+// Per-frame values shared by all programs in one uniform buffer, must match FrameUniforms in frameuniforms.h
+layout(std140) uniform FrameUniforms
+{
+	mat4 view;
+	mat4 projection;
+	vec4 lightpos;
+	uint colourmode;
+	uint attenuationmode;
+};
+
+// Per-draw values, streamed through a ring buffer, must match DrawUniforms in frameuniforms.h
+layout(std140) uniform DrawUniforms
+{
+	mat4 model;
+	mat3 normalmatrix;
+	uint emitmode;
+	uint instanced;
+};
 
 // Output pixel fragment colour
 out vec4 outputColor;
@@ -3,37 +3,65 @@
 // Specify minimum OpenGL version
 #version 400
 
-// Define the vertex attributes
+// Define the vertex attributes. The colour is stored as RGBA8 and the normal as 2_10_10_10, both are
+// normalised by the vertex fetch so arrive here as floats. The packed normal is only approximately
+// unit length so it is always renormalised after the normal matrix is applied
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec4 colour;
-layout(location = 2) in vec3 normal;
+layout(location = 2) in vec4 normal;
+layout(location = 3) in mat4 instancemodel;	// Per-instance model matrix, only read when instanced is set
+layout(location = 7) in vec4 tint;			// Multiplies the vertex colour, per instance or constant for the draw
+layout(location = 8) in mat3 instancenormal;	// Per-instance eye space normal matrix, only read when instanced is set
 
 // Outputs to send to the fragment shader
 out vec3 fnormal;
 out vec3 flightdir, fposition;
 out vec4 fdiffusecolour;
 
-// These are the uniforms that are defined in the application
-uniform mat4 model, view, projection;
-uniform mat3 normalmatrix;
-uniform uint colourmode;
-uniform vec4 lightpos;
+// Per-frame values shared by all programs in one uniform buffer, must match FrameUniforms in frameuniforms.h
+layout(std140) uniform FrameUniforms
+{
+	mat4 view;
+	mat4 projection;
+	vec4 lightpos;
+	uint colourmode;
+	uint attenuationmode;
+};
+
+// Per-draw values, streamed through a ring buffer, must match DrawUniforms in frameuniforms.h
+layout(std140) uniform DrawUniforms
+{
+	mat4 model;
+	mat3 normalmatrix;
+	uint emitmode;
+	uint instanced;
+};
 
 void main()
 {
 	vec4 position_h = vec4(position, 1.0);	// Convert the (x,y,z) position to homogeneous coords (x,y,z,w)
 	vec3 light_pos3 = lightpos.xyz;			
 
-	fdiffusecolour = colour;
+	fdiffusecolour = colour * tint;
+
+	// Instanced draws take the model and normal matrices from the instance attributes, which are calculated
+	// once per instance on the CPU rather than for every vertex here
+	mat4 model_matrix = model;
+	mat3 normal_matrix = normalmatrix;
+	if (instanced == 1)
+	{
+		model_matrix = instancemodel;
+		normal_matrix = instancenormal;
+	}
 
 	// Define our vectors for calculating diffuse and specular lighting
-	mat4 mv_matrix = view * model;				// Calculate the model-view transformation
+	mat4 mv_matrix = view * model_matrix;		// Calculate the model-view transformation
 	fposition = (mv_matrix * position_h).xyz;	// Transform the vertex position (x, y, z) into eye-space
-	fnormal = normalize(normalmatrix * normal);	// Modify the normal by the normal-matrix (i.e. transform to eye-space )
+	fnormal = normalize(normal_matrix * normal.xyz);	// Modify the normal by the normal-matrix (i.e. transform to eye-space )
 	flightdir = light_pos3 - fposition;			// Calculate the vector from the light position to the vertex in eye space
 
 	// Calculate the vertex position in projection space and output to the pipleline using the reserved variable gl_Position
-	gl_Position = (projection * view * model) * position_h;
+	gl_Position = (projection * mv_matrix) * position_h;
 }
 
 